@@ -61,6 +61,11 @@ public:
     platform,               //! AT_PLATFORM
     hardware_capabilities,  //! AT_HWCAP
     clock_tick,             //! AT_CLKTCK
+    secure = 23,            //! AT_SECURE
+    base_platform,          //! AT_BASE_PLATFORM
+    random,                 //! AT_RANDOM
+    hardware_capabilities_2,  //! AT_HWCAP2
+    executable_name = 31,   //! AT_EXECFN
   };
 
   vector type;
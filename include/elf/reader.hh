@@ -0,0 +1,264 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_elf_reader_hh
+#define multiload_elf_reader_hh
+
+#include "elf/types.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace elf {
+struct segment {
+  uint32_t type;
+  uint32_t flags;
+  uint64_t offset;
+  uint64_t virtual_address;
+  uint64_t file_size;
+  uint64_t memory_size;
+  uint64_t alignment;
+};
+
+// A bounds checked view of an ELF image which hides the differences between
+// the file classes and byte orders.
+class reader {
+  const uint8_t *base_;
+  size_t size_;
+  bool wide_;
+  bool swap_;
+  bool valid_;
+
+  template <typename Type>
+  Type read(const void *address) const noexcept {
+    Type value;
+    std::memcpy(&value, address, sizeof(value));
+    if (not swap_)
+      return value;
+    switch (sizeof(Type)) {
+    case 2: return static_cast<Type>(__builtin_bswap16(value));
+    case 4: return static_cast<Type>(__builtin_bswap32(value));
+    case 8: return static_cast<Type>(__builtin_bswap64(value));
+    }
+    return value;
+  }
+
+  template <size_t BitSex, typename Type>
+  Type field(Type header<BitSex>::*member) const noexcept {
+    const auto *ehdr = reinterpret_cast<const header<BitSex> *>(base_);
+    return read<Type>(&(ehdr->*member));
+  }
+
+  template <typename Type>
+  Type field(Type header<32>::*narrow, Type header<64>::*wide) const noexcept {
+    return wide_ ? field<64>(wide) : field<32>(narrow);
+  }
+
+public:
+  reader(const uint8_t *base, size_t size) noexcept
+      : base_(base), size_(size), wide_(false), swap_(false), valid_(false) {
+    if (size < sizeof(header<32>))
+      return;
+
+    const auto &identifier = *reinterpret_cast<const elf::identifier *>(base);
+    switch (static_cast<file_class>(
+        identifier[static_cast<int>(identifier_field::file_class)])) {
+    default:
+      return;
+    case file_class::class_32:
+      break;
+    case file_class::class_64:
+      if (size < sizeof(header<64>))
+        return;
+      wide_ = true;
+      break;
+    }
+
+    switch (static_cast<data_encoding>(
+        identifier[static_cast<int>(identifier_field::data_encoding)])) {
+    default:
+      return;
+    case data_encoding::lsb:
+      swap_ = __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__;
+      break;
+    case data_encoding::msb:
+      swap_ = __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__;
+      break;
+    }
+
+    valid_ = true;
+  }
+
+  explicit operator bool() const noexcept {
+    return valid_;
+  }
+
+  const uint8_t *base() const noexcept {
+    return base_;
+  }
+
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  bool wide() const noexcept {
+    return wide_;
+  }
+
+  bool big_endian() const noexcept {
+    return static_cast<data_encoding>(
+               base_[static_cast<int>(identifier_field::data_encoding)]) ==
+           data_encoding::msb;
+  }
+
+  elf::machine machine() const noexcept {
+    return static_cast<elf::machine>(read<uint16_t>(
+        &reinterpret_cast<const header<32> *>(base_)->machine_type));
+  }
+
+  uint64_t entry_point() const noexcept {
+    return wide_ ? field<64>(&header<64>::entry_point)
+                 : field<32>(&header<32>::entry_point);
+  }
+
+  uint32_t flags() const noexcept {
+    return field(&header<32>::flags, &header<64>::flags);
+  }
+
+  template <typename Type>
+  Type word(const uint8_t *address) const noexcept {
+    return read<Type>(address);
+  }
+
+  // returns the number of program headers which are addressable
+  size_t segments() const noexcept {
+    const uint64_t offset = wide_ ? field<64>(&header<64>::program_header_offset)
+                                  : field<32>(&header<32>::program_header_offset);
+    const size_t entry_size = wide_ ? sizeof(program_header<64>)
+                                    : sizeof(program_header<32>);
+    const auto count = field(&header<32>::program_headers,
+                             &header<64>::program_headers);
+
+    if (field(&header<32>::program_header_size,
+              &header<64>::program_header_size) != entry_size)
+      return 0;
+    if (offset > size_ or (size_ - offset) / entry_size < count)
+      return 0;
+    return count;
+  }
+
+  elf::segment segment(size_t index) const noexcept {
+    const uint64_t offset = wide_ ? field<64>(&header<64>::program_header_offset)
+                                  : field<32>(&header<32>::program_header_offset);
+    if (wide_) {
+      const auto *phdr =
+          reinterpret_cast<const elf::program_header<64> *>(base_ + offset) +
+          index;
+      return { read<uint32_t>(&phdr->type), read<uint32_t>(&phdr->flags),
+               read<uint64_t>(&phdr->offset),
+               read<uint64_t>(&phdr->virtual_address),
+               read<uint64_t>(&phdr->file_size),
+               read<uint64_t>(&phdr->memory_size),
+               read<uint64_t>(&phdr->alignment) };
+    }
+    const auto *phdr =
+        reinterpret_cast<const elf::program_header<32> *>(base_ + offset) +
+        index;
+    return { read<uint32_t>(&phdr->type), read<uint32_t>(&phdr->flags),
+             read<uint32_t>(&phdr->offset),
+             read<uint32_t>(&phdr->virtual_address),
+             read<uint32_t>(&phdr->file_size),
+             read<uint32_t>(&phdr->memory_size),
+             read<uint32_t>(&phdr->alignment) };
+  }
+
+  // returns the description of the first note of type owned by GNU within the
+  // segments of kind, or nullptr if there is none
+  const uint8_t *note(segment_type kind, note_type type,
+                      size_t &length) const noexcept {
+    const auto align = [](size_t value, size_t alignment) {
+      return (value + alignment - 1) & ~(alignment - 1);
+    };
+
+    for (size_t index = 0, count = segments(); index < count; ++index) {
+      const auto segment = this->segment(index);
+      if (segment.type != static_cast<uint32_t>(kind) or
+          segment.offset >= size_)
+        continue;
+
+      const size_t alignment = segment.alignment == 8 ? 8 : 4;
+      const uint8_t *note = base_ + segment.offset;
+      size_t remaining = segment.file_size < size_ - segment.offset
+                             ? segment.file_size
+                             : size_ - segment.offset;
+      while (remaining >= 12) {
+        const auto name_size = read<uint32_t>(note);
+        const auto description_size = read<uint32_t>(note + 4);
+
+        const size_t description = align(12 + name_size, alignment);
+        if (name_size > remaining or description > remaining or
+            description_size > remaining - description)
+          break;
+
+        if (read<uint32_t>(note + 8) == static_cast<uint32_t>(type) and
+            name_size == 4 and std::memcmp(note + 12, "GNU", 4) == 0) {
+          length = description_size;
+          return note + description;
+        }
+
+        const size_t next = align(description + description_size, alignment);
+        if (next >= remaining)
+          break;
+        note = note + next, remaining = remaining - next;
+      }
+    }
+    return nullptr;
+  }
+
+  // returns the path of the program interpreter (PT_INTERP), or nullptr if
+  // the image has none or the path does not lie within the image
+  const char *interpreter() const noexcept {
+    for (size_t index = 0, count = segments(); index < count; ++index) {
+      const auto segment = this->segment(index);
+      if (segment.type != static_cast<uint32_t>(segment_type::interpreter))
+        continue;
+      if (segment.offset >= size_ or segment.file_size == 0 or
+          segment.file_size > size_ - segment.offset)
+        return nullptr;
+
+      const auto *path = reinterpret_cast<const char *>(base_ + segment.offset);
+      return path[segment.file_size - 1] == '\0' ? path : nullptr;
+    }
+    return nullptr;
+  }
+};
+}
+
+#endif
@@ -100,6 +100,7 @@ enum class machine : uint16_t {
   nios2 = 113,        //! EM_ALTERA_NIOS2 (Altera NIOS II soft-core processor)
   c6000 = 140,        //! EM_TI_C6000 (TI C6X DSP)
   aarch64 = 183,      //! EM_AARCH64 (ARM 64-bit)
+  riscv = 243,        //! EM_RISCV (RISC-V)
   avr32 = 0x18ad,     //! EM_AVR32 (Atmel AVR32)
   frv = 0x5441,       //! EM_FRV (Fujitsu FR-V)
 };
@@ -115,6 +116,12 @@ enum class file_class : uint8_t {
   class_64, //! ELFCLASS64
 };
 
+enum class data_encoding : uint8_t {
+  none,           //! ELFDATANONE
+  lsb,            //! ELFDATA2LSB
+  msb,            //! ELFDATA2MSB
+};
+
 enum class identifier_field : uint8_t {
   magic0,         //! EI_MAG0
   magic1,         //! EI_MAG1
@@ -135,6 +142,23 @@ enum class flags : uint32_t {
   arm_gcc_mask = 0x00400fff,        //! EF_ARM_GCCMASK
   arm_abi_hard_float = 0x00000400,  //! EF_ARM_ABI_FLOAT_HARD
   arm_abi_soft_float = 0x00000200,  //! EF_ARM_ABI_SOFT_FLOAT
+
+  mips_noreorder = 0x00000001,      //! EF_MIPS_NOREORDER
+  mips_pic = 0x00000002,            //! EF_MIPS_PIC
+  mips_cpic = 0x00000004,           //! EF_MIPS_CPIC
+  mips_abi2 = 0x00000020,           //! EF_MIPS_ABI2
+  mips_fp64 = 0x00000200,           //! EF_MIPS_FP64
+  mips_nan2008 = 0x00000400,        //! EF_MIPS_NAN2008
+  mips_abi_mask = 0x0000f000,       //! EF_MIPS_ABI
+  mips_micromips = 0x02000000,      //! EF_MIPS_MICROMIPS
+  mips_arch_mask = 0xf0000000,      //! EF_MIPS_ARCH
+
+  ppc64_abi_mask = 0x00000003,      //! EF_PPC64_ABI
+
+  riscv_rvc = 0x00000001,           //! EF_RISCV_RVC
+  riscv_float_abi_mask = 0x00000006,  //! EF_RISCV_FLOAT_ABI
+  riscv_rve = 0x00000008,           //! EF_RISCV_RVE
+  riscv_tso = 0x00000010,           //! EF_RISCV_TSO
 };
 
 template <size_t BitSex>
@@ -159,6 +183,74 @@ public:
   uint16_t section_header_string_index;       //! e_shstrndx
 };
 
+enum class segment_type : uint32_t {
+  inactive,                                   //! PT_NULL
+  load,                                       //! PT_LOAD
+  dynamic,                                    //! PT_DYNAMIC
+  interpreter,                                //! PT_INTERP
+  note,                                       //! PT_NOTE
+  shared_library,                             //! PT_SHLIB
+  program_header,                             //! PT_PHDR
+  thread_local_storage,                       //! PT_TLS
+
+  /*!< extensions >*/
+  gnu_eh_frame = 0x6474e550,                  //! PT_GNU_EH_FRAME
+  gnu_stack = 0x6474e551,                     //! PT_GNU_STACK
+  gnu_relro = 0x6474e552,                     //! PT_GNU_RELRO
+  gnu_property = 0x6474e553,                  //! PT_GNU_PROPERTY
+};
+
+enum class note_type : uint32_t {
+  gnu_abi_tag = 1,                            //! NT_GNU_ABI_TAG
+  gnu_hardware_capabilities,                  //! NT_GNU_HWCAP
+  gnu_build_id,                               //! NT_GNU_BUILD_ID
+  gnu_gold_version,                           //! NT_GNU_GOLD_VERSION
+  gnu_property_type_0,                        //! NT_GNU_PROPERTY_TYPE_0
+};
+
+enum class gnu_property : uint32_t {
+  stack_size = 1,                             //! GNU_PROPERTY_STACK_SIZE
+  no_copy_on_protected,                       //! GNU_PROPERTY_NO_COPY_ON_PROTECTED
+  x86_feature_1_and = 0xc0000002,             //! GNU_PROPERTY_X86_FEATURE_1_AND
+  x86_isa_1_needed = 0xc0008002,              //! GNU_PROPERTY_X86_ISA_1_NEEDED
+};
+
+enum class x86_isa : uint32_t {
+  baseline = 1 << 0,                          //! GNU_PROPERTY_X86_ISA_1_BASELINE
+  v2 = 1 << 1,                                //! GNU_PROPERTY_X86_ISA_1_V2
+  v3 = 1 << 2,                                //! GNU_PROPERTY_X86_ISA_1_V3
+  v4 = 1 << 3,                                //! GNU_PROPERTY_X86_ISA_1_V4
+};
+
+template <size_t BitSex>
+class program_header;
+
+template <>
+class program_header<32> {
+public:
+  uint32_t type;             //! p_type
+  uint32_t offset;           //! p_offset
+  uint32_t virtual_address;  //! p_vaddr
+  uint32_t physical_address; //! p_paddr
+  uint32_t file_size;        //! p_filesz
+  uint32_t memory_size;      //! p_memsz
+  uint32_t flags;            //! p_flags
+  uint32_t alignment;        //! p_align
+};
+
+template <>
+class program_header<64> {
+public:
+  uint32_t type;             //! p_type
+  uint32_t flags;            //! p_flags
+  uint64_t offset;           //! p_offset
+  uint64_t virtual_address;  //! p_vaddr
+  uint64_t physical_address; //! p_paddr
+  uint64_t file_size;        //! p_filesz
+  uint64_t memory_size;      //! p_memsz
+  uint64_t alignment;        //! p_align
+};
+
 enum class section_type : uint32_t {
   inactive,                                   //! SHT_NULL
   program_bits,                               //! SHT_PROGBITS
@@ -203,6 +295,50 @@ public:
   word_t address_alignment;  //! sh_addralign
   word_t entry_size;         //! sh_entsize
 };
+
+enum class dynamic_tag : int64_t {
+  null,                                       //! DT_NULL
+  needed,                                     //! DT_NEEDED
+  plt_relocation_size,                        //! DT_PLTRELSZ
+  plt_got,                                    //! DT_PLTGOT
+  hash,                                       //! DT_HASH
+  string_table,                               //! DT_STRTAB
+  symbol_table,                               //! DT_SYMTAB
+  relocation_with_addend,                     //! DT_RELA
+  relocation_with_addend_size,                //! DT_RELASZ
+  relocation_with_addend_entry_size,          //! DT_RELAENT
+  string_table_size,                          //! DT_STRSZ
+  symbol_entry_size,                          //! DT_SYMENT
+  initializer,                                //! DT_INIT
+  finalizer,                                  //! DT_FINI
+  shared_object_name,                         //! DT_SONAME
+  rpath,                                      //! DT_RPATH
+  symbolic,                                   //! DT_SYMBOLIC
+  relocation,                                 //! DT_REL
+  relocation_size,                            //! DT_RELSZ
+  relocation_entry_size,                      //! DT_RELENT
+  plt_relocation,                             //! DT_PLTREL
+  debug,                                      //! DT_DEBUG
+  text_relocation,                            //! DT_TEXTREL
+  jump_relocation,                            //! DT_JMPREL
+  bind_now,                                   //! DT_BIND_NOW
+  initializer_array,                          //! DT_INIT_ARRAY
+  finalizer_array,                            //! DT_FINI_ARRAY
+  initializer_array_size,                     //! DT_INIT_ARRAYSZ
+  finalizer_array_size,                       //! DT_FINI_ARRAYSZ
+  runpath,                                    //! DT_RUNPATH
+  flags,                                      //! DT_FLAGS
+};
+
+template <size_t BitSex>
+class dynamic {
+  using signed_t = typename traits<BitSex>::signed_t;
+  using word_t = typename traits<BitSex>::unsigned_t;
+
+public:
+  signed_t tag;              //! d_tag
+  word_t value;              //! d_val, d_ptr
+};
 }
 
 #endif
@@ -0,0 +1,66 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_admission_hh
+#define multiload_admission_hh
+
+#include <cstddef>
+#include <cstdint>
+
+namespace multiload {
+// Admission control for the processes dispatched by a rule on behalf of a user.
+// Each rule has a lock file per user, as a user who could lock the slots of
+// another could starve it indefinitely, in which a byte range lock on one of
+// the first bytes represents a running process and a lock on a byte beyond the
+// queue base a waiting one.  The locks are open file description locks: they are carried
+// across exec and released by the kernel when the process exits, so neither a
+// crashed process nor a crashed waiter can leak a slot.
+namespace admission {
+enum class outcome {
+  admitted,
+  timed_out,
+};
+
+// wait (in FIFO order) for one of slots to become available for the rule
+// identified by key, giving up after timeout seconds unless it is zero; the
+// time spent waiting is returned in waited
+outcome acquire(uint64_t key, size_t slots, size_t timeout,
+                uint64_t &waited) noexcept;
+
+struct occupancy {
+  size_t running;
+  size_t waiting;
+};
+
+// the number of processes holding and waiting for slots of the rule
+occupancy inspect(uint64_t key) noexcept;
+}
+}
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_architecture_hh
+#define multiload_architecture_hh
+
+#include "multiload/configuration.hh"
+
+#include "elf/reader.hh"
+#include "elf/types.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace multiload {
+// The properties of an image derived from its header: the `subarch` and the
+// set of `flags` which rules may select on.
+struct features {
+  static constexpr const size_t capacity = 8;
+
+  const char *subarch = nullptr;
+  const char *flags[capacity] = {};
+  size_t count = 0;
+
+  void add(const char *flag) noexcept {
+    if (count < capacity)
+      flags[count++] = flag;
+  }
+};
+
+struct architecture {
+  const char *name;
+  elf::machine machine;
+  // the class of images for the architecture or none if both are used
+  elf::file_class file_class;
+  elf::data_encoding endian;
+  void (*decode)(const elf::reader &image, features &features);
+};
+
+// returns nullptr for machines which are not known
+const architecture *lookup(elf::machine machine) noexcept;
+const architecture *lookup_architecture(const std::string &name) noexcept;
+
+// the other names by which the architecture is known in the names of files
+// and directories (e.g. amd64 for x86_64), terminated by nullptr
+const char *const *aliases(const architecture &architecture) noexcept;
+
+const architecture *begin_architectures() noexcept;
+const architecture *end_architectures() noexcept;
+
+// the validator for all ELF images: checks the arch, endian, subarch and flags
+// keys of the rule against the header of the image, and the isa key against
+// the property note of x86 images.
+//
+// An isa rule selects between the rules for the images which reach multiload;
+// it does not bring any image to multiload.  The machine of the host is never
+// registered with binfmt_misc, so on an x86-64 host an x86_64 image executed
+// directly is run by the kernel whatever level it needs (and fails with
+// SIGILL if the host lacks it).  Only an image executed through ld-multiload
+// explicitly, e.g. by a wrapper or a build system, is run natively by an isa
+// rule when the host suffices and by a following emulator rule otherwise.
+// Images of a compatible machine (i386) are claimed when they are dynamically
+// linked.  Either way, a native rule executes the image through its PT_INTERP,
+// and static images fall through to the following rules.
+bool validate(const uint8_t *base, size_t size,
+              const configuration::constraints &constraints);
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_binary_format_hh
+#define multiload_binary_format_hh
+
+#include "multiload/configuration.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace multiload {
+// The number of leading bytes of a binary which are consulted to identify its
+// format.  The window is always addressable (the mapping of a non-empty file is
+// at least a page), so decoders may read within it without bounds checks.
+constexpr const size_t probe_length = 128;
+
+struct binary_format {
+  using validator = bool (*)(const uint8_t *base, size_t size,
+                             const configuration::constraints &constraints);
+
+  const char *name;
+
+  // decode the header of the binary, returning the validator which determines
+  // if a rule is applicable or nullptr if the header is malformed or describes
+  // something which cannot be dispatched
+  validator (*decode)(const uint8_t *base, size_t size);
+};
+
+extern const binary_format &elf_format;
+
+const binary_format *identify(const uint8_t *base, size_t size) noexcept;
+const binary_format *lookup(const std::string &name) noexcept;
+}
+
+#endif
@@ -35,29 +35,10 @@
 #include "elf/types.hh"
 
 namespace multiload {
-namespace arch {
-namespace aarch64 {
-bool validate(const uint8_t *base,
-              const configuration::constraints &constraints);
-}
-
-namespace arm {
-bool validate(const uint8_t *base,
-              const configuration::constraints &constraints);
-}
-
-namespace i386 {
-bool validate(const uint8_t *base,
-              const configuration::constraints &constraints);
-}
-
-namespace x86_64 {
-bool validate(const uint8_t *base,
-              const configuration::constraints &constraints);
-}
-}
+struct binary_format;
 
-void validate_loader(elf::machine machine_type, const std::string &path);
+void validate_loader(const binary_format &format, const uint8_t *base,
+                     const std::string &path);
 }
 
 #endif
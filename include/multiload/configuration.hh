@@ -30,11 +30,17 @@
 #ifndef multiload_configuration_hh
 #define multiload_configuration_hh
 
+#include "multiload/policy.hh"
+#include "multiload/probe.hh"
+#include "multiload/statistics.hh"
+
 #include <string>
 #include <tuple>
 #include <vector>
 
 namespace multiload {
+struct binary_format;
+
 class configuration {
 public:
   struct constraint {
@@ -47,19 +53,92 @@ public:
   struct rule {
     configuration::constraints constraints;
     std::string loader;
+    const binary_format *format = nullptr;
+    size_t index = 0;
+    size_t source = 0;
+    uint64_t fingerprint = 0;
+    probe::extent extent = probe::extent::header;
+    configuration::constraints screen;
+    bool native = false;
+    size_t readahead = 0;
+    std::vector<std::string> resident;
+    std::string sysroot;
+    size_t prefetch = 0;
+    std::string execfd;
+    std::string variant;
+    multiload::policy policy;
+    size_t max_concurrent = 0;
+    size_t queue_timeout = 0;
+    std::string forkserver;
+    std::vector<std::string> forkable;
+    std::vector<std::string> candidates;
+    size_t explore = 5;
   };
 
 private:
   const std::string file_;
+  std::vector<std::string> overlays_;
+  std::vector<std::string> sources_;
   std::vector<rule> rules_;
+  uint64_t fingerprint_ = 0;
+  multiload::statistics statistics_;
+
+  bool layer() noexcept;
+  void append(std::vector<rule> &&rules);
+  bool resolve() noexcept;
 
 public:
   configuration(const std::string &file) : file_(file) {}
   ~configuration() = default;
 
+  // layer the rules of file over those of the configuration; overlays take
+  // precedence in the order in which they are added
+  void overlay(const std::string &file) {
+    overlays_.push_back(file);
+  }
+
   bool load() noexcept;
+  bool load(const uint8_t *image, size_t size) noexcept;
+
+  // the rules of a configuration which has already been merged, as serialized
+  // by serialize(); overlays are not layered over them again
+  bool restore(const uint8_t *image, size_t size) noexcept;
+
+  // a stamp of the files from which the configuration is read, which changes
+  // when any of them is modified, added or removed
+  uint64_t generation() const noexcept;
+  void compile() noexcept;
+
+  std::string serialize() const;
+
+  // the image of a list of rules, as stored in a compiled configuration
+  static std::string serialize(const std::vector<rule> &rules);
+  static bool deserialize(const uint8_t *image, size_t size,
+                          std::vector<rule> &rules);
+
+  // diagnose rules which can never be selected and rules of different files
+  // which overlap, so that their order decides between them
+  std::vector<std::string> check() const;
+
+  const std::vector<rule> &rules() const noexcept {
+    return rules_;
+  }
+
+  // the files from which the rules were read, indexed by rule::source
+  const std::vector<std::string> &sources() const noexcept {
+    return sources_;
+  }
+
+  uint64_t fingerprint() const noexcept {
+    return fingerprint_;
+  }
+
+  const rule *select(const binary_format &format,
+                     multiload::probe &probe) const noexcept;
 
-  [[noreturn]] void dispatch(const uint8_t *base, char *argv[]) const noexcept;
+  [[noreturn]] void dispatch(const binary_format &format, int fd,
+                             multiload::probe &probe,
+                             char *argv[]) const noexcept;
 };
 }
 
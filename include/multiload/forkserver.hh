@@ -0,0 +1,105 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_forkserver_hh
+#define multiload_forkserver_hh
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace multiload {
+// A fork server keeps a loader parked after it has initialized a binary and
+// forks it for each execution of that binary.  multiload-forkserver listens on
+// a socket named for the binary within the directory of the rule and starts
+// the loader with MULTILOAD_FORKSERVER naming the descriptor of its control
+// channel.  Each invocation is passed along the control channel: the parked
+// loader forks, the child adopts the descriptors, arguments and environment of
+// the invocation and runs the binary, and the parent reports the pid and later
+// the wait status of the child.
+namespace forkserver {
+// descriptors accompanying an invocation: stdin, stdout, stderr and the
+// working directory
+constexpr const size_t descriptors = 4;
+
+struct invocation {
+  int descriptors[forkserver::descriptors] = { -1, -1, -1, -1 };
+  std::vector<std::string> arguments;
+  std::vector<std::string> environment;
+
+  invocation() = default;
+  invocation(const invocation &) = delete;
+  invocation &operator=(const invocation &) = delete;
+  ~invocation() noexcept;
+};
+
+struct reply {
+  enum kind : uint32_t {
+    ready,      // the loader has parked
+    started,    // the invocation is running as pid
+    refused,    // the invocation could not be started
+    exited,     // pid has terminated with status
+  };
+
+  uint32_t kind;
+  int32_t pid;
+  int32_t status;
+};
+
+// the path of the socket serving binary (a canonical path) within directory
+std::string socket(const std::string &directory, const std::string &binary);
+
+// whether binary (a canonical path) matches one of the patterns in binaries
+bool admits(const std::vector<std::string> &binaries,
+            const std::string &binary) noexcept;
+
+// the transport shared by the client, the daemon and the parked loader; the
+// descriptors of a received invocation are owned by the invocation
+bool send(int channel, const invocation &invocation) noexcept;
+bool receive(int channel, invocation &invocation) noexcept;
+bool send(int channel, const reply &reply) noexcept;
+bool receive(int channel, reply &reply) noexcept;
+
+// hand the execution of argv[1] off to its fork server and exit with the
+// status of the child; returns only if the binary is not one of binaries or
+// no fork server run by the effective user or root is available for it
+void execute(const std::string &directory,
+             const std::vector<std::string> &binaries, char *argv[]) noexcept;
+
+// park the loader on the control channel; returns in the child of each
+// invocation, with the invocation in effect and its arguments in arguments,
+// and exits once the control channel is closed
+void park(int control, std::vector<std::string> &arguments) noexcept;
+}
+}
+
+#endif
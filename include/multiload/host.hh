@@ -0,0 +1,68 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_host_hh
+#define multiload_host_hh
+
+#include "elf/reader.hh"
+#include "elf/types.hh"
+
+namespace multiload {
+namespace host {
+// the machine of the host as reported by the kernel (AT_PLATFORM)
+elf::machine machine() noexcept;
+
+// the x86-64 micro-architecture level (1 through 4) supported by the host, or
+// 0 if the host is not x86
+unsigned isa_level() noexcept;
+
+// determine if the host is able to execute images of the machine without a
+// loader (which some images may still require, see below)
+bool can_execute(elf::machine machine, bool big_endian) noexcept;
+
+// determine if the host is able to execute the image without a loader; the
+// image must be dynamically linked and its interpreter installed on the host
+bool can_execute(const elf::reader &image) noexcept;
+
+// determine if the process was granted privileges by the execution (AT_SECURE),
+// in which case the environment must not influence the dispatch
+bool secure() noexcept;
+
+// execute the image, named by argv[1], through its interpreter: the image was
+// handed to multiload because binfmt_misc claims it, and would be claimed
+// again were it executed itself
+[[noreturn]] void execute(const elf::reader &image, char *argv[]) noexcept;
+
+// terminate as the child with the wait status status did, re-raising the
+// signal which terminated it
+[[noreturn]] void propagate(int status) noexcept;
+}
+}
+
+#endif
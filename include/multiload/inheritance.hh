@@ -0,0 +1,59 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_inheritance_hh
+#define multiload_inheritance_hh
+
+#include <cstdint>
+#include <string>
+
+namespace multiload {
+class configuration;
+
+// The compiled configuration is handed down a process tree in a sealed memfd
+// which is inherited across execution, so that the dispatches of descendants
+// need not read the configuration at all.  The descriptor is named by a single
+// environment variable, MULTILOAD_MEMFD=fd:generation:checksum, which each
+// publication replaces.  An image is only used if it can no longer be
+// modified, is of the generation of the files from which the configuration is
+// read, and matches its checksum; a descriptor which has been closed, reused
+// or altered is ignored.  As any process of the tree could equally name an
+// overlay, the image grants it nothing more.
+namespace inheritance {
+constexpr const char variable[] = "MULTILOAD_MEMFD";
+
+// load the configuration from the image handed down by an ancestor
+bool inherit(uint64_t generation, configuration &configuration) noexcept;
+
+// hand the compiled configuration down to the descendants of the process
+void bequeath(uint64_t generation, const std::string &image) noexcept;
+}
+}
+
+#endif
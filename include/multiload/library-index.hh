@@ -0,0 +1,72 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_library_index_hh
+#define multiload_library_index_hh
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace multiload {
+// A cached map from soname to path for the libraries of a sysroot.  The index
+// is keyed by the search path of the sysroot (its ld.so.conf and the default
+// directories) and is considered stale as soon as any of them is modified.
+class library_index {
+  void *base_;
+  size_t size_;
+
+public:
+  // the search path used by the dynamic linker if ld.so.conf is silent
+  static constexpr const char *const defaults[] = {
+    "/lib", "/usr/lib", "/lib64", "/usr/lib64",
+  };
+
+  library_index(const library_index &) = delete;
+  library_index &operator=(const library_index &) = delete;
+
+  library_index() noexcept : base_(nullptr), size_(0) {}
+  ~library_index() noexcept;
+
+  // map the index of sysroot, failing if it is absent or out of date
+  bool open(const std::string &sysroot) noexcept;
+
+  // scan the search path of sysroot and replace its index
+  static bool build(const std::string &sysroot) noexcept;
+
+  explicit operator bool() const noexcept {
+    return base_ != nullptr;
+  }
+
+  // returns the path of the library with the given soname, if indexed
+  const char *find(const char *soname) const noexcept;
+};
+}
+
+#endif
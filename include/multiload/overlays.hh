@@ -0,0 +1,60 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_overlays_hh
+#define multiload_overlays_hh
+
+#include "multiload/configuration.hh"
+
+#include <string>
+#include <vector>
+
+namespace multiload {
+// Configurations which are layered over the configuration of the host for a
+// single job, taking precedence over it.  Overlays are typically written per
+// job, so that their compiled rules are cached by the hash of their content
+// rather than by their inode: jobs of a user which use the same overlay share
+// a single compilation.  The cache of each user holds a bounded number of
+// overlays, evicting those least recently used; an entry is only ever replaced
+// or removed as a whole, so that a concurrent reader sees either the entry or
+// none.
+namespace overlays {
+// the most overlays which are cached
+constexpr const size_t capacity = 256;
+
+// the overlays named by a colon separated list, in order of precedence
+std::vector<std::string> enumerate(const char *list);
+
+// the rules of the overlay, compiled or read from the cache
+bool load(const std::string &path,
+          std::vector<configuration::rule> &rules) noexcept;
+}
+}
+
+#endif
@@ -38,10 +38,17 @@
 namespace multiload {
 class lexer;
 
+// parse a size in bytes, optionally suffixed by K, M or G
+bool parse_size(const char *value, size_t &size) noexcept;
+
 class parser {
   lexer &lexer_;
 
+  std::string parse_value();
+  size_t parse_size();
+
   configuration::constraint parse_constraint();
+  void parse_directive(configuration::rule &rule);
   configuration::rule parse_rule();
 
 public:
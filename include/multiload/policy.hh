@@ -0,0 +1,74 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_policy_hh
+#define multiload_policy_hh
+
+#include <cstddef>
+#include <string>
+
+#include <sched.h>
+
+namespace multiload {
+// The resource policy of a rule, applied to the process immediately before
+// the loader is executed.  Everything which requires parsing is done ahead of
+// time so that applying the policy is a handful of syscalls; only the cgroup of
+// the rule which is selected is opened.
+class policy {
+  cpu_set_t affinity_;
+  bool pinned_ = false;
+  int scheduler_ = -1;
+  int priority_ = 0;
+  bool reniced_ = false;
+  int ioprio_ = -1;
+
+public:
+  // as written in the configuration
+  std::string affinity;      // cpu list: 0-3,8 or node:N
+  std::string scheduler;     // other, batch or idle
+  std::string nice;          // -20 ... 19
+  std::string ioprio;        // idle, best-effort[:level] or realtime[:level]
+  std::string cgroup;        // cgroup v2 directory, relative to /sys/fs/cgroup
+  size_t address_space = 0;  // RLIMIT_AS, 0 if unconstrained
+  size_t files = 0;          // RLIMIT_NOFILE, 0 if unconstrained
+
+  bool empty() const noexcept {
+    return affinity.empty() and scheduler.empty() and nice.empty() and
+           ioprio.empty() and cgroup.empty() and not address_space and
+           not files;
+  }
+
+  // validate the policy and compute the affinity mask and priorities
+  bool resolve(std::string &error);
+
+  void apply() const noexcept;
+};
+}
+
+#endif
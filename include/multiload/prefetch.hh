@@ -0,0 +1,57 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_prefetch_hh
+#define multiload_prefetch_hh
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace multiload {
+// schedule asynchronous readahead of the PT_LOAD segments of the ELF image
+// backed by fd, starting with the segment containing the entry point; at most
+// budget bytes are requested
+void prefetch_segments(int fd, const uint8_t *base, size_t size,
+                       size_t budget) noexcept;
+
+// the time which may be spent locating libraries; the readahead is only of use
+// while the loader starts
+constexpr const long library_deadline = 2000000;  // ns
+
+// schedule asynchronous readahead of the libraries which the ELF image at path
+// depends upon, as resolved within sysroot; at most budget bytes are requested.
+// The libraries are located by a detached process, so that the loader is
+// executed without waiting for them; a missing or stale index of the sysroot
+// is rebuilt once they have been, for the dispatches which follow.
+void prefetch_libraries(const char *path, const uint8_t *base, size_t size,
+                        const std::string &sysroot, size_t budget) noexcept;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_probe_hh
+#define multiload_probe_hh
+
+#include <cstddef>
+#include <cstdint>
+
+namespace multiload {
+// the leading bytes of an ELF image which are searched for its notes
+constexpr const size_t note_window = 4 * 4096;
+
+// A lazily read view of a binary.  The view reserves the size of the binary
+// and reads a prefix of it on demand, so that a dispatch reads no more of the
+// binary than the rules which it consults require.  The binary is mapped in
+// its entirety only once an action requires it.
+class probe {
+public:
+  // the prefixes which rules may inspect, in order of cost
+  enum class extent : uint8_t {
+    header,     // the first page, holding the file header of every format
+    notes,      // the note window, holding the ELF program headers and notes
+    image,      // the whole binary
+  };
+
+private:
+  const int fd_;
+  uint8_t *base_;
+  const size_t size_;
+  size_t length_ = 0;
+  size_t reads_ = 0;
+  size_t bytes_ = 0;
+
+public:
+  probe(const probe &) = delete;
+  probe &operator=(const probe &) = delete;
+
+  // a view of the binary open as fd
+  probe(int fd, size_t size) noexcept;
+
+  // a view of a captured prefix of a binary; reads are only accounted
+  probe(const uint8_t *image, size_t size) noexcept;
+
+  ~probe() noexcept;
+
+  // make the extent addressable, returning false if it cannot be read
+  bool fetch(extent extent) noexcept;
+
+  const uint8_t *base() const noexcept {
+    return base_;
+  }
+
+  // the number of leading bytes which are addressable
+  size_t size() const noexcept {
+    return length_;
+  }
+
+  size_t reads() const noexcept {
+    return reads_;
+  }
+
+  size_t bytes() const noexcept {
+    return bytes_;
+  }
+};
+}
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_runtimes_hh
+#define multiload_runtimes_hh
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace multiload {
+// A per user record of how long each candidate loader of a rule took to run
+// a binary, from which the fastest is selected.  The record is a fixed size
+// open addressed table of cache line sized slots which is mapped shared; each
+// slot is guarded by a sequence lock so that the lookup made by a dispatch is
+// a bounded number of probes which never blocks on a writer.
+namespace runtimes {
+// the most loaders a rule may list, including its own
+constexpr const size_t candidates = 4;
+
+struct sample {
+  uint32_t runs;
+  uint32_t mean;      // us
+};
+
+// the key of a binary for a set of loaders: the inode of the binary and, for
+// ELF images, its build-id or else its modification time
+uint64_t key(const std::string &loader,
+             const std::vector<std::string> &alternatives, int fd,
+             const uint8_t *base, size_t size) noexcept;
+
+// the recorded runtimes of the binary; false if there is no history
+bool lookup(uint64_t key, sample (&samples)[candidates]) noexcept;
+
+// the loader to execute the binary with: the fastest on record, another one
+// explore percent of the time, and the first when there is no history
+size_t choose(uint64_t key, size_t count, unsigned explore) noexcept;
+
+// record that candidate ran the binary to completion in duration ns
+void record(uint64_t key, size_t candidate, uint64_t duration) noexcept;
+
+// run the loader as a child, recording its runtime if it succeeds, and exit
+// as it did
+[[noreturn]] void supervise(uint64_t key, size_t candidate, const char *loader,
+                            char *argv[]) noexcept;
+}
+}
+
+#endif
@@ -50,6 +50,12 @@ public:
   operator int() const noexcept {
     return fd_;
   }
+
+  int release() noexcept {
+    const int fd = fd_;
+    fd_ = -1;
+    return fd;
+  }
 };
 }
 
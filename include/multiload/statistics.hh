@@ -0,0 +1,92 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef multiload_statistics_hh
+#define multiload_statistics_hh
+
+#include "elf/types.hh"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace multiload {
+// Dispatch counters shared by the invocations of multiload of a user.  The
+// counters are sharded per CPU and each shard is padded to a cache line so
+// that concurrent dispatches on different CPUs never contend.  Each rule has
+// counters for its dispatches and for the time they spent waiting for
+// admission.  Each rule set has a file of its own, named for its fingerprint;
+// a file is replaced (never resized) when it does not match, so existing
+// mappings remain valid.
+class statistics {
+public:
+  // one bucket per e_machine below 256, and one for all others
+  static constexpr const size_t machines = 257;
+
+private:
+  void *base_;
+  size_t size_;
+  size_t cpus_;
+  size_t rules_;
+
+  uint64_t *rule_shard(size_t cpu) const noexcept;
+  void increment(size_t counter, uint64_t value) const noexcept;
+  uint64_t total(size_t counter) const noexcept;
+  uint64_t *miss_shard(size_t cpu) const noexcept;
+
+public:
+  statistics(const statistics &) = delete;
+  statistics &operator=(const statistics &) = delete;
+
+  statistics() noexcept : base_(nullptr), size_(0), cpus_(0), rules_(0) {}
+  ~statistics() noexcept;
+
+  // map the counters for the rule set identified by fingerprint, creating the
+  // counters if writable is set
+  bool open(uint64_t fingerprint, size_t rules, bool writable) noexcept;
+
+  explicit operator bool() const noexcept {
+    return base_ != nullptr;
+  }
+
+  void hit(size_t rule) const noexcept;
+  void miss(elf::machine machine) const noexcept;
+
+  // record a dispatch which waited for admission (nanoseconds)
+  void waited(size_t rule, uint64_t duration, bool timed_out) const noexcept;
+
+  uint64_t hits(size_t rule) const noexcept;
+  uint64_t misses(size_t bucket) const noexcept;
+
+  uint64_t waits(size_t rule) const noexcept;
+  uint64_t wait_time(size_t rule) const noexcept;
+  uint64_t timeouts(size_t rule) const noexcept;
+};
+}
+
+#endif
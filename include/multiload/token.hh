@@ -48,7 +48,29 @@ public:
     kw_subarch,
     kw_endian,
     kw_flags,
+    kw_format,
+    kw_interpreter,
     kw_loader,
+    kw_readahead,
+    kw_resident,
+    kw_prefetch,
+    kw_sysroot,
+    kw_execfd,
+    kw_variant,
+    kw_affinity,
+    kw_cgroup,
+    kw_ioprio,
+    kw_nice,
+    kw_rlimit_as,
+    kw_rlimit_nofile,
+    kw_scheduler,
+    kw_isa,
+    kw_max_concurrent,
+    kw_queue_timeout,
+    kw_forkserver,
+    kw_forkable,
+    kw_candidate,
+    kw_explore,
 
     literal,
   };
@@ -64,6 +64,7 @@ std::ostream &operator<<(std::ostream &os,
                          const format::details::hex<Type> &hex) {
   os << std::internal << std::showbase << std::setfill('0')
      << std::setw(sizeof(Type) * 2 + 2) << std::hex << static_cast<Type>(hex);
+  return os;
 }
 
 #endif
@@ -0,0 +1,56 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#ifndef support_hash_hh
+#define support_hash_hh
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hash {
+// 64-bit FNV-1a
+constexpr const uint64_t fnv1a_basis = 0xcbf29ce484222325ull;
+
+constexpr uint64_t fnv1a(const void *data, size_t length,
+                         uint64_t hash = fnv1a_basis) noexcept {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t byte = 0; byte < length; ++byte)
+    hash = (hash ^ bytes[byte]) * 0x100000001b3ull;
+  return hash;
+}
+
+inline uint64_t fnv1a(const std::string &value,
+                      uint64_t hash = fnv1a_basis) noexcept {
+  // include the terminator so that adjacent strings cannot alias
+  return fnv1a(value.c_str(), value.length() + 1, hash);
+}
+}
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/admission.hh"
+#include "multiload/state.hh"
+
+#include <algorithm>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+// the ticket counter occupies the start of the file which is mapped; slots and
+// tickets are locks on single bytes which need not be backed by the file
+constexpr const size_t length = 4096;
+constexpr const off_t slot_base = 64;
+constexpr const off_t queue_base = static_cast<off_t>(1) << 32;
+
+constexpr const long initial_delay = 1000000;    // ns
+constexpr const long maximum_delay = 50000000;   // ns
+
+std::string location(uint64_t key) {
+  return multiload::state::location("admission", key);
+}
+
+// a lock may be taken by anyone who may open the file, so neither the group
+// nor others may have access to it
+bool exclusive(const struct stat &st) noexcept {
+  return multiload::state::trusted(st) and (st.st_mode & 077) == 0;
+}
+
+bool lock(int fd, short type, off_t offset) noexcept {
+  struct flock lock = {};
+  lock.l_type = type;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = offset;
+  lock.l_len = 1;
+  return ::fcntl(fd, F_OFD_SETLK, &lock) == 0;
+}
+
+// the offset of a lock held on the range by another open file description, or
+// -1 if there is none; a length of 0 extends the range indefinitely
+off_t held(int fd, off_t start, off_t length) noexcept {
+  struct flock lock = {};
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = start;
+  lock.l_len = length;
+  if (::fcntl(fd, F_OFD_GETLK, &lock) < 0 or lock.l_type == F_UNLCK)
+    return -1;
+  return lock.l_start;
+}
+
+// the number of locks held on [start, end), where an end of 0 is unbounded
+size_t count(int fd, off_t start, off_t end) noexcept {
+  if (end and start >= end)
+    return 0;
+  const off_t found = held(fd, start, end ? end - start : 0);
+  if (found < 0)
+    return 0;
+  return 1 + count(fd, start, found) + count(fd, found + 1, end);
+}
+
+bool claim(int fd, size_t slots) noexcept {
+  // start at a different slot in each process to avoid probing held slots
+  const size_t first = ::getpid() % slots;
+  for (size_t slot = 0; slot < slots; ++slot)
+    if (lock(fd, F_WRLCK, slot_base + (first + slot) % slots))
+      return true;
+  return false;
+}
+
+uint64_t now() noexcept {
+  struct timespec time;
+  ::clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+}
+
+namespace multiload {
+namespace admission {
+outcome acquire(uint64_t key, size_t slots, size_t timeout,
+                uint64_t &waited) noexcept {
+  waited = 0;
+
+  // admission control is best effort: if the lock file is unavailable the
+  // process is admitted
+  const int fd = ::open(location(key).c_str(),
+                        O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (fd < 0)
+    return outcome::admitted;
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 or not exclusive(st) or
+      (static_cast<size_t>(st.st_size) < length and
+       ::ftruncate(fd, length) < 0)) {
+    ::close(fd);
+    return outcome::admitted;
+  }
+
+  // nobody is queued and a slot is available
+  if (held(fd, queue_base, 0) < 0 and claim(fd, slots)) {
+    ::fcntl(fd, F_SETFD, 0);
+    return outcome::admitted;
+  }
+
+  void *base = ::mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    ::close(fd);
+    return outcome::admitted;
+  }
+  const uint64_t ticket =
+      __atomic_fetch_add(static_cast<uint64_t *>(base), 1, __ATOMIC_SEQ_CST);
+  ::munmap(base, length);
+
+  const off_t position = queue_base + static_cast<off_t>(ticket);
+  lock(fd, F_WRLCK, position);
+
+  const uint64_t start = now();
+  long delay = initial_delay;
+  for (;;) {
+    // the waiters which preceded us have either been admitted or have died
+    if ((ticket == 0 or held(fd, queue_base, ticket) < 0) and
+        claim(fd, slots))
+      break;
+
+    if (timeout and now() - start >= timeout * 1000000000ull) {
+      waited = now() - start;
+      ::close(fd);
+      return outcome::timed_out;
+    }
+
+    const struct timespec interval = { 0, delay };
+    ::nanosleep(&interval, nullptr);
+    delay = std::min(delay * 2, maximum_delay);
+  }
+
+  lock(fd, F_UNLCK, position);
+  waited = now() - start;
+
+  // the slot is held by the loader until it exits
+  ::fcntl(fd, F_SETFD, 0);
+  return outcome::admitted;
+}
+
+occupancy inspect(uint64_t key) noexcept {
+  const int fd = ::open(location(key).c_str(),
+                        O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0)
+    return { 0, 0 };
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 or not exclusive(st)) {
+    ::close(fd);
+    return { 0, 0 };
+  }
+
+  const occupancy result = { count(fd, slot_base, queue_base),
+                             count(fd, queue_base, 0) };
+  ::close(fd);
+  return result;
+}
+}
+}
@@ -0,0 +1,353 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/architecture.hh"
+#include "multiload/binary-format.hh"
+#include "multiload/host.hh"
+#include "multiload/probe.hh"
+
+#include "support/compiler.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace {
+using multiload::features;
+
+constexpr uint32_t flag(elf::flags value) noexcept {
+  return static_cast<uint32_t>(value);
+}
+
+void decode_arm(const elf::reader &image, features &features) {
+  static const char *const eabi[] = {
+    "eabi0", "eabi1", "eabi2", "eabi3", "eabi4", "eabi5",
+  };
+
+  const auto flags = image.flags();
+  const auto version = (flags & flag(elf::flags::arm_abi_mask)) >> 24;
+  if (version < sizeof(eabi) / sizeof(*eabi))
+    features.subarch = eabi[version];
+
+  if (flags & flag(elf::flags::arm_abi_hard_float))
+    features.add("hard-float");
+  if (flags & flag(elf::flags::arm_abi_soft_float))
+    features.add("soft-float");
+  if (flags & flag(elf::flags::arm_big_endian))
+    features.add("be8");
+}
+
+void decode_mips(const elf::reader &image, features &features) {
+  static const char *const isa[] = {
+    "mips1", "mips2", "mips3", "mips4", "mips5", "mips32", "mips64",
+    "mips32r2", "mips64r2", "mips32r6", "mips64r6",
+  };
+  static const char *const abi[] = {
+    nullptr, "o32", "o64", "eabi32", "eabi64",
+  };
+
+  const auto flags = image.flags();
+  const auto level = (flags & flag(elf::flags::mips_arch_mask)) >> 28;
+  if (level < sizeof(isa) / sizeof(*isa))
+    features.subarch = isa[level];
+
+  const auto model = (flags & flag(elf::flags::mips_abi_mask)) >> 12;
+  if (flags & flag(elf::flags::mips_abi2))
+    features.add("n32");
+  else if (model and model < sizeof(abi) / sizeof(*abi))
+    features.add(abi[model]);
+  else
+    features.add(image.wide() ? "n64" : "o32");
+
+  if (flags & flag(elf::flags::mips_pic))
+    features.add("pic");
+  if (flags & flag(elf::flags::mips_cpic))
+    features.add("cpic");
+  if (flags & flag(elf::flags::mips_fp64))
+    features.add("fp64");
+  if (flags & flag(elf::flags::mips_nan2008))
+    features.add("nan2008");
+  if (flags & flag(elf::flags::mips_micromips))
+    features.add("micromips");
+}
+
+void decode_ppc64(const elf::reader &image, features &features) {
+  switch (image.flags() & flag(elf::flags::ppc64_abi_mask)) {
+  case 1:
+    features.add("elfv1");
+    break;
+  case 2:
+    features.add("elfv2");
+    break;
+  default:
+    // unmarked images use the default ABI for their byte order
+    features.add(image.big_endian() ? "elfv1" : "elfv2");
+    break;
+  }
+}
+
+void decode_riscv(const elf::reader &image, features &features) {
+  static const char *const abi[] = {
+    "soft-float", "single-float", "double-float", "quad-float",
+  };
+
+  const auto flags = image.flags();
+  features.subarch = image.wide() ? "rv64" : "rv32";
+  features.add(abi[(flags & flag(elf::flags::riscv_float_abi_mask)) >> 1]);
+  if (flags & flag(elf::flags::riscv_rvc))
+    features.add("rvc");
+  if (flags & flag(elf::flags::riscv_rve))
+    features.add("rve");
+  if (flags & flag(elf::flags::riscv_tso))
+    features.add("tso");
+}
+
+void decode_x86_64(const elf::reader &image, features &features) {
+  if (not image.wide())
+    features.subarch = "x32";
+}
+
+constexpr size_t align(size_t value, size_t alignment) noexcept {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+unsigned isa_level(const elf::reader &image, const uint8_t *properties,
+                   size_t length) noexcept {
+  const size_t alignment = image.wide() ? 8 : 4;
+  for (size_t offset = 0; length - offset >= 8;) {
+    const auto type = image.word<uint32_t>(properties + offset);
+    const auto size = image.word<uint32_t>(properties + offset + 4);
+    if (size > length - offset - 8)
+      break;
+    if (type == static_cast<uint32_t>(elf::gnu_property::x86_isa_1_needed) and
+        size >= 4) {
+      const auto needed = image.word<uint32_t>(properties + offset + 8);
+      return needed ? 32 - __builtin_clz(needed) : 1;
+    }
+    offset = offset + 8 + align(size, alignment);
+    if (offset > length)
+      break;
+  }
+  return 1;
+}
+
+// the x86-64 level which the image requires as recorded in its GNU property
+// note, found through PT_GNU_PROPERTY or else PT_NOTE; images which do not
+// record one require the baseline
+unsigned isa_level(const elf::reader &image) noexcept {
+  for (const auto kind : { elf::segment_type::gnu_property,
+                           elf::segment_type::note }) {
+    size_t length;
+    if (const uint8_t *properties =
+            image.note(kind, elf::note_type::gnu_property_type_0, length))
+      return isa_level(image, properties, length);
+  }
+  return 1;
+}
+
+using elf::data_encoding;
+using elf::file_class;
+using elf::machine;
+
+constexpr const multiload::architecture architectures[] = {
+  { "m32", machine::m32, file_class::class_32, data_encoding::msb, nullptr },
+  { "sparc", machine::sparc, file_class::class_32, data_encoding::msb,
+    nullptr },
+  { "i386", machine::i386, file_class::class_32, data_encoding::lsb, nullptr },
+  { "m68k", machine::m68k, file_class::class_32, data_encoding::msb, nullptr },
+  { "m88k", machine::m88k, file_class::class_32, data_encoding::msb, nullptr },
+  { "i486", machine::i486, file_class::class_32, data_encoding::lsb, nullptr },
+  { "i860", machine::i860, file_class::class_32, data_encoding::lsb, nullptr },
+  { "mips", machine::mips, file_class::none, data_encoding::msb,
+    decode_mips },
+  { "mips_rs3_le", machine::mips_rs3_le, file_class::class_32,
+    data_encoding::lsb, decode_mips },
+  { "parisc", machine::parisc, file_class::none, data_encoding::msb,
+    nullptr },
+  { "sparc32plus", machine::sparc32_plus, file_class::class_32,
+    data_encoding::msb, nullptr },
+  { "ppc", machine::ppc, file_class::class_32, data_encoding::msb, nullptr },
+  { "ppc64", machine::ppc64, file_class::class_64, data_encoding::msb,
+    decode_ppc64 },
+  { "s390", machine::s390, file_class::none, data_encoding::msb, nullptr },
+  { "spu", machine::spu, file_class::class_32, data_encoding::msb, nullptr },
+  { "arm", machine::arm, file_class::class_32, data_encoding::lsb,
+    decode_arm },
+  { "sh", machine::sh, file_class::class_32, data_encoding::lsb, nullptr },
+  { "sparcv9", machine::sparcv9, file_class::class_64, data_encoding::msb,
+    nullptr },
+  { "ia64", machine::itanium, file_class::class_64, data_encoding::lsb,
+    nullptr },
+  { "x86_64", machine::x86_64, file_class::none, data_encoding::lsb,
+    decode_x86_64 },
+  { "cris", machine::cris, file_class::class_32, data_encoding::lsb, nullptr },
+  { "v850", machine::v850, file_class::class_32, data_encoding::lsb, nullptr },
+  { "m32r", machine::m32r, file_class::class_32, data_encoding::msb, nullptr },
+  { "mn10300", machine::mn10300, file_class::class_32, data_encoding::lsb,
+    nullptr },
+  { "or1k", machine::openrisc, file_class::class_32, data_encoding::msb,
+    nullptr },
+  { "blackfin", machine::blackfin, file_class::class_32, data_encoding::lsb,
+    nullptr },
+  { "nios2", machine::nios2, file_class::class_32, data_encoding::lsb,
+    nullptr },
+  { "c6000", machine::c6000, file_class::class_32, data_encoding::lsb,
+    nullptr },
+  { "aarch64", machine::aarch64, file_class::class_64, data_encoding::lsb,
+    nullptr },
+  { "riscv", machine::riscv, file_class::none, data_encoding::lsb,
+    decode_riscv },
+  { "avr32", machine::avr32, file_class::class_32, data_encoding::msb,
+    nullptr },
+  { "frv", machine::frv, file_class::class_32, data_encoding::msb, nullptr },
+};
+
+constexpr const size_t direct = 256;
+
+// the registry is indexed directly by e_machine; the few machines beyond the
+// table are found by a search of the tail of architectures
+struct table {
+  const multiload::architecture *entries[direct];
+};
+
+constexpr table build() noexcept {
+  table registry{};
+  for (const auto &architecture : architectures)
+    if (static_cast<size_t>(architecture.machine) < direct)
+      registry.entries[static_cast<size_t>(architecture.machine)] =
+          &architecture;
+  return registry;
+}
+
+constexpr const table registry = build();
+
+static_assert(registry.entries[static_cast<size_t>(machine::x86_64)]->machine ==
+                  machine::x86_64,
+              "registry must be indexed by e_machine");
+}
+
+namespace multiload {
+MULTILOAD_HOT const architecture *lookup(elf::machine machine) noexcept {
+  const auto index = static_cast<size_t>(machine);
+  if (__builtin_expect(index < direct, true))
+    return registry.entries[index];
+
+  for (const auto &architecture : architectures)
+    if (architecture.machine == machine)
+      return &architecture;
+  return nullptr;
+}
+
+const architecture *lookup_architecture(const std::string &name) noexcept {
+  for (const auto &architecture : architectures)
+    if (name == architecture.name)
+      return &architecture;
+  return nullptr;
+}
+
+const char *const *aliases(const architecture &architecture) noexcept {
+  static const char *const none[] = { nullptr };
+  static const char *const x86_64[] = { "amd64", "x86-64", nullptr };
+  static const char *const i386[] = { "i686", "i586", "x86", nullptr };
+  static const char *const aarch64[] = { "arm64", nullptr };
+  static const char *const arm[] = { "armhf", "armel", "armv7l", nullptr };
+  static const char *const ppc64[] = { "ppc64le", "ppc64el", nullptr };
+  static const char *const riscv[] = { "riscv64", "riscv32", nullptr };
+  static const char *const mips[] = { "mipsel", "mips64", "mips64el",
+                                      nullptr };
+
+  switch (architecture.machine) {
+  default: return none;
+  case machine::x86_64: return x86_64;
+  case machine::i386: return i386;
+  case machine::aarch64: return aarch64;
+  case machine::arm: return arm;
+  case machine::ppc64: return ppc64;
+  case machine::riscv: return riscv;
+  case machine::mips: return mips;
+  }
+}
+
+const architecture *begin_architectures() noexcept {
+  return std::begin(architectures);
+}
+
+const architecture *end_architectures() noexcept {
+  return std::end(architectures);
+}
+
+MULTILOAD_HOT bool validate(const uint8_t *base, size_t size,
+                            const configuration::constraints &constraints) {
+  // the header always resides within the probe window
+  const elf::reader image(base, probe_length);
+  const auto *architecture = lookup(image.machine());
+
+  bool named = false;
+  bool decoded = false;
+  features features;
+
+  for (const auto &constraint : constraints) {
+    if (constraint.key == "arch") {
+      if (constraint.value != architecture->name)
+        return false;
+      named = true;
+    } else if (constraint.key == "endian") {
+      if (constraint.value != (image.big_endian() ? "big" : "little"))
+        return false;
+    } else if (constraint.key == "subarch" or constraint.key == "flags") {
+      if (not decoded and architecture->decode)
+        architecture->decode(image, features);
+      decoded = true;
+
+      if (constraint.key == "subarch") {
+        if (not features.subarch or constraint.value != features.subarch)
+          return false;
+      } else {
+        if (std::none_of(features.flags, features.flags + features.count,
+                         [&constraint](const char *flag) {
+                           return constraint.value == flag;
+                         }))
+          return false;
+      }
+    } else if (constraint.key == "isa") {
+      // only consulted by rules which name an ISA level
+      if (image.machine() != elf::machine::x86_64 and
+          image.machine() != elf::machine::i386)
+        return false;
+      const unsigned limit = constraint.value == "host"
+                                 ? host::isa_level()
+                                 : constraint.value.back() - '0';
+      if (isa_level(elf::reader(base, std::min(size, note_window))) > limit)
+        return false;
+    }
+  }
+
+  return named;
+}
+}
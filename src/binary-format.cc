@@ -0,0 +1,270 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/binary-format.hh"
+#include "multiload/architecture.hh"
+
+#include "elf/reader.hh"
+#include "elf/types.hh"
+
+#include "support/compiler.hh"
+
+#include <cstring>
+#include <iterator>
+
+namespace {
+template <size_t Length>
+constexpr uint64_t pack(const char (&bytes)[Length]) noexcept {
+  static_assert(Length - 1 <= sizeof(uint64_t), "signature exceeds a word");
+  uint64_t value = 0;
+  for (size_t byte = 0; byte < Length - 1; ++byte)
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[byte]))
+             << (8 * byte);
+  return value;
+}
+
+inline uint16_t read16le(const uint8_t *address) noexcept {
+  return address[0] | address[1] << 8;
+}
+
+inline uint32_t read32(const uint8_t *address, bool big_endian) noexcept {
+  if (big_endian)
+    return uint32_t(address[0]) << 24 | uint32_t(address[1]) << 16 |
+           uint32_t(address[2]) << 8 | uint32_t(address[3]);
+  return uint32_t(address[3]) << 24 | uint32_t(address[2]) << 16 |
+         uint32_t(address[1]) << 8 | uint32_t(address[0]);
+}
+
+bool matches(const multiload::configuration::constraints &constraints,
+             const char *key, const char *value) noexcept {
+  for (const auto &constraint : constraints)
+    if (constraint.key == key and constraint.value != value)
+      return false;
+  return true;
+}
+}
+
+namespace multiload {
+namespace formats {
+namespace elf {
+binary_format::validator decode(const uint8_t *base, size_t size) {
+  const ::elf::reader image(base, size);
+  if (not image or not multiload::lookup(image.machine()))
+    return nullptr;
+  return multiload::validate;
+}
+}
+
+namespace pe {
+enum : uint16_t {
+  image_file_machine_i386 = 0x014c,   //! IMAGE_FILE_MACHINE_I386
+  image_file_machine_arm = 0x01c0,    //! IMAGE_FILE_MACHINE_ARM
+  image_file_machine_armnt = 0x01c4,  //! IMAGE_FILE_MACHINE_ARMNT
+  image_file_machine_amd64 = 0x8664,  //! IMAGE_FILE_MACHINE_AMD64
+  image_file_machine_arm64 = 0xaa64,  //! IMAGE_FILE_MACHINE_ARM64
+};
+
+// e_lfanew, the offset of the NT headers from the start of the DOS header
+constexpr const size_t new_header_offset = 0x3c;
+
+const char *arch(const uint8_t *base) noexcept {
+  const auto *nt = base + read32(base + new_header_offset, false);
+  switch (read16le(nt + 4)) {
+  case image_file_machine_i386:
+    return "i386";
+  case image_file_machine_arm:
+  case image_file_machine_armnt:
+    return "arm";
+  case image_file_machine_amd64:
+    return "x86_64";
+  case image_file_machine_arm64:
+    return "aarch64";
+  }
+  return "";
+}
+
+bool validate(const uint8_t *base, size_t,
+              const configuration::constraints &constraints) {
+  return matches(constraints, "arch", arch(base));
+}
+
+binary_format::validator decode(const uint8_t *base, size_t size) {
+  if (size < new_header_offset + 4)
+    return nullptr;
+  const auto offset = read32(base + new_header_offset, false);
+  // PE\0\0 followed by the COFF file header
+  if (size < 24 or offset > size - 24)
+    return nullptr;
+  if (std::memcmp(base + offset, "PE\0\0", 4))
+    return nullptr;
+  return validate;
+}
+}
+
+namespace macho {
+enum : uint32_t {
+  cpu_arch_abi64 = 0x01000000,                    //! CPU_ARCH_ABI64
+  cpu_type_x86 = 7,                               //! CPU_TYPE_X86
+  cpu_type_x86_64 = cpu_type_x86 | cpu_arch_abi64,  //! CPU_TYPE_X86_64
+  cpu_type_arm = 12,                              //! CPU_TYPE_ARM
+  cpu_type_arm64 = cpu_type_arm | cpu_arch_abi64,   //! CPU_TYPE_ARM64
+};
+
+const char *arch(const uint8_t *base) noexcept {
+  // MH_MAGIC and MH_MAGIC_64 are stored big endian as 0xfe 0xed ...
+  const bool big_endian = base[0] == 0xfe;
+  switch (read32(base + 4, big_endian)) {
+  case cpu_type_x86:
+    return "i386";
+  case cpu_type_x86_64:
+    return "x86_64";
+  case cpu_type_arm:
+    return "arm";
+  case cpu_type_arm64:
+    return "aarch64";
+  }
+  return "";
+}
+
+bool validate(const uint8_t *base, size_t,
+              const configuration::constraints &constraints) {
+  return matches(constraints, "arch", arch(base));
+}
+
+binary_format::validator decode(const uint8_t *, size_t size) {
+  // magic, cputype, cpusubtype, filetype, ncmds, sizeofcmds, flags
+  return size < 28 ? nullptr : validate;
+}
+}
+
+namespace wasm {
+bool validate(const uint8_t *, size_t, const configuration::constraints &) {
+  return true;
+}
+
+binary_format::validator decode(const uint8_t *, size_t size) {
+  // magic, version
+  return size < 8 ? nullptr : validate;
+}
+}
+
+namespace script {
+bool validate(const uint8_t *base, size_t,
+              const configuration::constraints &constraints) {
+  // the interpreter is the first word following the #!; the probe window is
+  // zero filled beyond the end of the file which terminates the scan
+  const auto *begin = reinterpret_cast<const char *>(base) + 2;
+  const auto *end = reinterpret_cast<const char *>(base) + probe_length;
+  while (begin < end and (*begin == ' ' or *begin == '\t'))
+    ++begin;
+  const auto *cursor = begin;
+  while (cursor < end and *cursor and not std::strchr(" \t\r\n", *cursor))
+    ++cursor;
+
+  for (const auto &constraint : constraints)
+    if (constraint.key == "interpreter" and
+        constraint.value.compare(0, std::string::npos, begin, cursor - begin))
+      return false;
+  return true;
+}
+
+binary_format::validator decode(const uint8_t *, size_t) {
+  return validate;
+}
+}
+}
+
+namespace {
+const binary_format registry[] = {
+  { "elf", formats::elf::decode },
+  { "pe", formats::pe::decode },
+  { "macho", formats::macho::decode },
+  { "wasm", formats::wasm::decode },
+  { "script", formats::script::decode },
+};
+
+struct signature {
+  size_t offset;
+  size_t length;
+  uint64_t mask;
+  uint64_t value;
+  const binary_format *format;
+};
+
+// All signatures are compared against a single little-endian word loaded from
+// their offset.  The table is ordered by frequency; ELF is first so that its
+// identification costs a single load and compare.
+const signature signatures[] = {
+  { 0, 4, pack("\xff\xff\xff\xff"), pack("\x7f" "ELF"), &registry[0] },
+  { 0, 2, pack("\xff\xff"), pack("#!"), &registry[4] },
+  { 0, 2, pack("\xff\xff"), pack("MZ"), &registry[1] },
+  // MH_CIGAM, MH_CIGAM_64
+  { 0, 4, pack("\xfe\xff\xff\xff"), pack("\xce\xfa\xed\xfe"), &registry[2] },
+  // MH_MAGIC, MH_MAGIC_64
+  { 0, 4, pack("\xff\xff\xff\xfe"), pack("\xfe\xed\xfa\xce"), &registry[2] },
+  { 0, 4, pack("\xff\xff\xff\xff"), pack("\0asm"), &registry[3] },
+};
+
+static_assert(pack(elf::magic) == pack("\x7f" "ELF"),
+              "ELF signature does not match the ELF magic");
+
+inline uint64_t load(const uint8_t *address, size_t available) noexcept {
+  uint64_t word = 0;
+  if (__builtin_expect(available >= sizeof(word), true))
+    std::memcpy(&word, address, sizeof(word));
+  else
+    std::memcpy(&word, address, available);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+}
+
+const binary_format &elf_format = registry[0];
+
+MULTILOAD_HOT const binary_format *
+identify(const uint8_t *base, size_t size) noexcept {
+  for (const auto &signature : signatures) {
+    if (signature.offset + signature.length > size)
+      continue;
+    const auto word = load(base + signature.offset, size - signature.offset);
+    if ((word & signature.mask) == signature.value)
+      return signature.format;
+  }
+  return nullptr;
+}
+
+const binary_format *lookup(const std::string &name) noexcept {
+  for (const auto &format : registry)
+    if (name == format.name)
+      return &format;
+  return nullptr;
+}
+}
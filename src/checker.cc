@@ -28,7 +28,11 @@
  **/
 
 #include "multiload/checker.hh"
+#include "multiload/binary-format.hh"
 
+#include "elf/reader.hh"
+
+#include "support/compiler.hh"
 #include "support/format.hh"
 
 #include <cstring>
@@ -38,75 +42,50 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-namespace multiload {
-void validate_loader(elf::machine machine_type, const std::string &loader) {
-  if (loader.empty()) {
+namespace {
+[[noreturn]] MULTILOAD_COLD void
+unspecified(const multiload::binary_format &format, const uint8_t *base) {
+  if (&format == &multiload::elf_format) {
+    const auto machine_type =
+        elf::reader(base, multiload::probe_length).machine();
     std::cerr << "cannot load binary for machine "
               << format::hex(static_cast<uint16_t>(machine_type))
               << ": no loader specified" << std::endl;
-    ::exit(EXIT_FAILURE);
-  }
-
-  struct stat mld;
-  if (::stat("/proc/self/exe", &mld) < 0) {
-    std::cerr << "unable to stat '/proc/self/exe': " << std::strerror(errno)
-              << std::endl;
-    ::exit(EXIT_FAILURE);
-  }
-
-  struct stat ldr;
-  if (::stat(loader.c_str(), &ldr) < 0) {
-    std::cerr << "unable to stat '" << loader << "':" << std::strerror(errno)
-              << std::endl;
-    ::exit(EXIT_FAILURE);
-  }
-
-  if (mld.st_dev == ldr.st_dev and mld.st_ino == ldr.st_ino) {
-    std::cerr << "recursively invoking multiload is not permitted" << std::endl;
-    ::exit(EXIT_FAILURE);
+  } else {
+    std::cerr << "cannot load " << format.name
+              << " binary: no loader specified" << std::endl;
   }
+  ::exit(EXIT_FAILURE);
 }
 
-namespace arch {
-namespace aarch64 {
-bool validate(const uint8_t *base,
-              const multiload::configuration::constraints &constraints) {
-  for (const auto &constraint : constraints)
-    if (constraint.key == "arch")
-      return constraint.value == "aarch64";
-  return false;
-}
+[[noreturn]] MULTILOAD_COLD void unavailable(const char *path) {
+  std::cerr << "unable to stat '" << path << "': " << std::strerror(errno)
+            << std::endl;
+  ::exit(EXIT_FAILURE);
 }
 
-namespace arm {
-bool validate(const uint8_t *base,
-              const multiload::configuration::constraints &constraints) {
-  for (const auto &constraint : constraints)
-    if (constraint.key == "arch")
-      return constraint.value == "arm";
-  return false;
+[[noreturn]] MULTILOAD_COLD void recursive() {
+  std::cerr << "recursively invoking multiload is not permitted" << std::endl;
+  ::exit(EXIT_FAILURE);
 }
 }
 
-namespace i386 {
-bool validate(const uint8_t *base,
-              const multiload::configuration::constraints &constraints) {
-  for (const auto &constraint : constraints)
-    if (constraint.key == "arch")
-      return constraint.value == "i386";
-  return false;
-}
-}
+namespace multiload {
+MULTILOAD_HOT void validate_loader(const binary_format &format,
+                                   const uint8_t *base,
+                                   const std::string &loader) {
+  if (loader.empty())
+    unspecified(format, base);
 
-namespace x86_64 {
-bool validate(const uint8_t *base,
-              const multiload::configuration::constraints &constraints) {
-  for (const auto &constraint : constraints)
-    if (constraint.key == "arch")
-      return constraint.value == "x86_64";
-  return false;
-}
-}
+  struct stat mld;
+  if (::stat("/proc/self/exe", &mld) < 0)
+    unavailable("/proc/self/exe");
+
+  struct stat ldr;
+  if (::stat(loader.c_str(), &ldr) < 0)
+    unavailable(loader.c_str());
+
+  if (mld.st_dev == ldr.st_dev and mld.st_ino == ldr.st_ino)
+    recursive();
 }
 }
-
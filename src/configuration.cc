@@ -28,113 +28,528 @@
  **/
 
 #include "multiload/configuration.hh"
+#include "multiload/admission.hh"
+#include "multiload/architecture.hh"
+#include "multiload/binary-format.hh"
 #include "multiload/checker.hh"
-#include "multiload/lexer.hh"
-#include "multiload/parser.hh"
-#include "multiload/scoped-file-descriptor.hh"
-#include "multiload/scoped-mmap.hh"
+#include "multiload/forkserver.hh"
+#include "multiload/fragments.hh"
+#include "multiload/host.hh"
+#include "multiload/overlays.hh"
+#include "multiload/prefetch.hh"
+#include "multiload/probe.hh"
+#include "multiload/runtimes.hh"
 
-#include "elf/types.hh"
+#include "elf/reader.hh"
 
-#include "support/format.hh"
+#include "support/compiler.hh"
+#include "support/hash.hh"
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <functional>
 #include <iostream>
-#include <tuple>
+#include <iterator>
+#include <map>
+#include <utility>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
-namespace multiload {
-bool configuration::load() noexcept {
-  multiload::scoped_file_descriptor fd(::open(file_.c_str(),
-                                              O_RDONLY | O_CLOEXEC));
-  if (fd < 0) {
-    std::cerr << "unable to open '" << file_ << "': "
-              << std::strerror(errno) << std::endl;
-    return false;
+namespace {
+MULTILOAD_COLD bool unable(const char *action, const std::string &path) {
+  std::cerr << "unable to " << action << " '" << path << "': "
+            << std::strerror(errno) << std::endl;
+  return false;
+}
+
+MULTILOAD_COLD bool rejected(const std::string &message,
+                             const std::string &loader) {
+  std::cerr << message << " for loader '" << loader << "'" << std::endl;
+  return false;
+}
+
+MULTILOAD_COLD bool rejected(const char *message, const std::string &value,
+                             const std::string &loader) {
+  return rejected(std::string(message) + " '" + value + "'", loader);
+}
+
+[[noreturn]] MULTILOAD_COLD void expired(const char *binary,
+                                        const std::string &loader) {
+  std::cerr << "timed out waiting to execute '" << binary << "' with '"
+            << loader << "'" << std::endl;
+  ::exit(EXIT_FAILURE);
+}
+
+// rules are disjoint if no binary may satisfy both of them: either they apply
+// to different formats or they require different values for the same key
+// (other than those which may be satisfied by several values)
+bool disjoint(const multiload::configuration::rule &lhs,
+              const multiload::configuration::rule &rhs) noexcept {
+  if (lhs.format != rhs.format)
+    return true;
+
+  for (const auto &constraint : lhs.constraints) {
+    if (constraint.key == "flags" or constraint.key == "isa")
+      continue;
+    for (const auto &other : rhs.constraints)
+      if (other.key == constraint.key and other.value != constraint.value)
+        return true;
   }
 
-  struct stat st;
-  if (::fstat(fd, &st) < 0) {
-    std::cerr << "unable to stat '" << file_ << "': "
-              << std::strerror(errno) << std::endl;
+  return false;
+}
+
+// every binary which satisfies the rule also satisfies the other: its
+// constraints include all of those of the other
+bool covers(const multiload::configuration::rule &rule,
+            const multiload::configuration::rule &other) noexcept {
+  if (rule.format != other.format)
+    return false;
+
+  for (const auto &constraint : other.constraints)
+    if (std::none_of(rule.constraints.begin(), rule.constraints.end(),
+                     [&constraint](const multiload::configuration::constraint
+                                       &candidate) {
+                       return candidate.key == constraint.key and
+                              candidate.value == constraint.value;
+                     }))
+      return false;
+
+  return true;
+}
+
+// the prefix of the binary which must be read to evaluate a constraint
+multiload::probe::extent
+cost(const multiload::configuration::constraint &constraint) noexcept {
+  return constraint.key == "isa" ? multiload::probe::extent::notes
+                                 : multiload::probe::extent::header;
+}
+
+// the names of an architecture which may appear in a path, canonical first
+std::vector<const char *> names(const multiload::architecture &architecture) {
+  std::vector<const char *> names{ architecture.name };
+  for (const auto *alias = multiload::aliases(architecture); *alias; ++alias)
+    names.push_back(*alias);
+  return names;
+}
+
+// the text lies at the end of the path or of one of its components, and at
+// the start of one unless it brings its own separator (e.g. .%a)
+bool bounded(const std::string &path, size_t position,
+             const std::string &text) noexcept {
+  const size_t end = position + text.length();
+  return (position == 0 or path[position - 1] == '/' or
+          not std::isalnum(static_cast<unsigned char>(text.front()))) and
+         (end == path.length() or path[end] == '/' or text.back() == '/');
+}
+
+// the directories in which variants have been looked for: the names of the
+// host are each probed with the lookup of a single component
+bool executable(const std::string &path) {
+  static std::map<std::string, int> directories;
+
+  const auto separator = path.rfind('/');
+  const std::string directory =
+      separator == std::string::npos ? "." : path.substr(0, separator + 1);
+
+  auto entry = directories.find(directory);
+  if (entry == directories.end())
+    entry = directories
+                .emplace(directory,
+                         ::open(directory.c_str(),
+                                O_PATH | O_DIRECTORY | O_CLOEXEC))
+                .first;
+
+  return entry->second >= 0 and
+         ::faccessat(entry->second,
+                     path.c_str() + (separator == std::string::npos
+                                         ? 0 : separator + 1),
+                     X_OK, 0) == 0;
+}
+
+// the sibling of path built for the host, following a naming convention in
+// which %a stands for a name of the architecture
+bool sibling(const std::string &pattern, const char *path,
+             elf::machine machine, std::string &variant) {
+  const auto *guest = multiload::lookup(machine);
+  const auto *host = multiload::lookup(multiload::host::machine());
+  if (not guest or not host or guest == host)
+    return false;
+
+  const auto architecture = pattern.find("%a");
+  const auto expand = [&pattern, architecture](const char *name) {
+    return pattern.substr(0, architecture) + name +
+           pattern.substr(architecture + 2);
+  };
+
+  const std::string binary = path;
+  for (const auto *name : names(*guest)) {
+    const std::string foreign = expand(name);
+
+    size_t position = binary.rfind(foreign);
+    while (position != std::string::npos and
+           not bounded(binary, position, foreign))
+      position = position ? binary.rfind(foreign, position - 1)
+                          : std::string::npos;
+    if (position == std::string::npos)
+      continue;
+
+    for (const auto *native : names(*host)) {
+      variant = binary;
+      variant.replace(position, foreign.length(), expand(native));
+      if (executable(variant))
+        return true;
+    }
     return false;
   }
 
-  void *base = ::mmap(NULL, st.st_size, PROT_READ,
-                      MAP_PRIVATE | MAP_NONBLOCK | MAP_NORESERVE, fd, 0);
-  multiload::scoped_mmap mapping(base, st.st_size);
-  if (mapping == MAP_FAILED) {
-    std::cerr << "unable to mmap '" << file_ << "': "
-              << std::strerror(errno) << std::endl;
+  return false;
+}
+}
+
+namespace multiload {
+MULTILOAD_HOT bool configuration::load() noexcept {
+  const auto files = fragments::enumerate(file_);
+  if (files.empty())
+    return unable("open", file_);
+
+  if (not layer())
     return false;
+
+  for (const auto &file : files) {
+    std::vector<rule> rules;
+    if (not fragments::load(file, rules))
+      return false;
+    sources_.push_back(file);
+    append(std::move(rules));
+  }
+
+  return resolve();
+}
+
+uint64_t configuration::generation() const noexcept {
+  auto files = overlays_;
+  for (auto &file : fragments::enumerate(file_))
+    files.push_back(std::move(file));
+
+  uint64_t stamp = hash::fnv1a(file_);
+  for (const auto &file : files) {
+    struct stat st;
+    if (::stat(file.c_str(), &st) < 0)
+      std::memset(&st, 0, sizeof(st));
+
+    stamp = hash::fnv1a(file, stamp);
+    stamp = hash::fnv1a(&st.st_dev, sizeof(st.st_dev), stamp);
+    stamp = hash::fnv1a(&st.st_ino, sizeof(st.st_ino), stamp);
+    stamp = hash::fnv1a(&st.st_size, sizeof(st.st_size), stamp);
+    stamp = hash::fnv1a(&st.st_mtim, sizeof(st.st_mtim), stamp);
+  }
+  return stamp;
+}
+
+// begin the rules with those of the overlays, which are consulted first
+bool configuration::layer() noexcept {
+  sources_.clear();
+  rules_.clear();
+
+  for (const auto &file : overlays_) {
+    std::vector<rule> rules;
+    if (not overlays::load(file, rules))
+      return false;
+    sources_.push_back(file);
+    append(std::move(rules));
+  }
+
+  return true;
+}
+
+// add the rules of the last source
+void configuration::append(std::vector<rule> &&rules) {
+  for (auto &rule : rules) {
+    rule.source = sources_.size() - 1;
+    rules_.push_back(std::move(rule));
   }
+}
+
+std::vector<std::string> configuration::check() const {
+  std::vector<std::string> diagnostics;
+
+  const auto describe = [this](const rule &rule) {
+    return "rule " + std::to_string(rule.index + 1) + " ('" + rule.loader +
+           "') of '" + sources_[rule.source] + "'";
+  };
+
+  // rules are consulted in order, so that a rule is only reached by binaries
+  // which none of the rules before it has claimed
+  for (const auto &rule : rules_) {
+    for (const auto *prior = rules_.data(); prior != &rule; ++prior) {
+      // a native rule yields to the later rules on a foreign host
+      if (prior->native)
+        continue;
+
+      if (covers(rule, *prior)) {
+        diagnostics.push_back(describe(rule) + " is shadowed by " +
+                              describe(*prior));
+        break;
+      }
+
+      if (prior->source != rule.source and prior->loader != rule.loader and
+          not disjoint(*prior, rule))
+        diagnostics.push_back(describe(rule) + " conflicts with " +
+                              describe(*prior));
+    }
+  }
+
+  return diagnostics;
+}
+
+MULTILOAD_HOT bool configuration::resolve() noexcept {
+  fingerprint_ = hash::fnv1a_basis;
+  for (auto &rule : rules_) {
+    rule.index = &rule - rules_.data();
+
+    // the image is executed directly when the host is capable of doing so
+    rule.native = rule.loader == "native";
+
+    // the constraints are a conjunction: evaluating the cheap ones first lets
+    // a rule be rejected before the more expensive ones are read, and those
+    // which only need the header screen the rule before anything more is read
+    std::stable_sort(rule.constraints.begin(), rule.constraints.end(),
+                     [](const constraint &lhs, const constraint &rhs) {
+                       return cost(lhs) < cost(rhs);
+                     });
+    rule.extent = rule.constraints.empty() ? probe::extent::header
+                                           : cost(rule.constraints.back());
+    // a native image is executed through the interpreter which it names
+    if (rule.native)
+      rule.extent = std::max(rule.extent, probe::extent::notes);
+    rule.screen.clear();
+    if (rule.extent != probe::extent::header)
+      std::copy_if(rule.constraints.begin(), rule.constraints.end(),
+                   std::back_inserter(rule.screen),
+                   [](const constraint &constraint) {
+                     return cost(constraint) == probe::extent::header;
+                   });
+
+    rule.fingerprint = hash::fnv1a(rule.loader);
+    for (const auto &constraint : rule.constraints) {
+      rule.fingerprint = hash::fnv1a(constraint.key, rule.fingerprint);
+      rule.fingerprint = hash::fnv1a(constraint.value, rule.fingerprint);
+    }
+    fingerprint_ = hash::fnv1a(&rule.fingerprint, sizeof(rule.fingerprint),
+                               fingerprint_);
+
+    // the loader may be handed the descriptor of the binary rather than a path
+    if (not rule.execfd.empty() and rule.execfd != "proc")
+      return rejected("unsupported execfd protocol", rule.execfd, rule.loader);
+
+    // paths within the sysroot are always absolute
+    while (not rule.sysroot.empty() and rule.sysroot.back() == '/')
+      rule.sysroot.pop_back();
+
+    rule.format = &elf_format;
+    for (const auto &constraint : rule.constraints) {
+      if (constraint.key != "format")
+        continue;
+      if (not (rule.format = multiload::lookup(constraint.value)) or
+          (rule.native and rule.format != &elf_format))
+        return rejected("unsupported binary format", constraint.value,
+                        rule.loader);
+    }
+
+    for (const auto &constraint : rule.constraints) {
+      if (rule.format != &elf_format)
+        continue;
+      if (constraint.key == "arch" and
+          not multiload::lookup_architecture(constraint.value))
+        return rejected("unknown architecture", constraint.value, rule.loader);
+      if (constraint.key == "isa" and constraint.value != "host" and
+          not (constraint.value.length() == 9 and
+               constraint.value.compare(0, 8, "x86-64-v") == 0 and
+               constraint.value[8] >= '1' and constraint.value[8] <= '4'))
+        return rejected("unknown ISA level", constraint.value, rule.loader);
+    }
+
+    // a variant pattern names the architecture exactly once
+    const auto architecture = rule.variant.find("%a");
+    if (not rule.variant.empty() and
+        (rule.format != &elf_format or architecture == std::string::npos or
+         rule.variant.find("%a", architecture + 2) != std::string::npos))
+      return rejected("invalid variant pattern", rule.variant, rule.loader);
 
-  multiload::lexer lexer(static_cast<const char *>(base), st.st_size);
-  multiload::parser parser(lexer);
+    // a queue is only formed when the concurrency of the rule is limited
+    if (rule.queue_timeout and not rule.max_concurrent)
+      return rejected("queue timeout without a concurrency limit",
+                      rule.loader);
+
+    std::string error;
+    if (not rule.policy.resolve(error))
+      return rejected(error, rule.loader);
+
+    // the sockets of the fork servers are named within an absolute directory
+    if (not rule.forkserver.empty() and
+        (rule.forkserver.front() != '/' or rule.forkable.empty()))
+      return rejected("invalid fork server", rule.forkserver, rule.loader);
+
+    // the candidates share a slot of the runtime record with the loader
+    if (rule.candidates.size() >= runtimes::candidates or rule.explore > 100 or
+        (not rule.candidates.empty() and
+         (rule.native or std::find(rule.candidates.begin(),
+                                   rule.candidates.end(),
+                                   "native") != rule.candidates.end())))
+      return rejected("invalid candidate loaders", rule.loader);
+  }
 
-  rules_ = parser.parse();
   return not rules_.empty();
 }
 
-[[noreturn]] void
-configuration::dispatch(const uint8_t *base, char *argv[]) const noexcept {
+MULTILOAD_HOT void configuration::compile() noexcept {
+  statistics_.open(fingerprint_, rules_.size(), true);
+
+#if defined(MULTILOAD_HOT_FIRST)
+  if (not statistics_)
+    return;
+
+  // insertion sort by frequency which only ever exchanges adjacent disjoint
+  // rules, so the first rule matching any binary is unchanged
+  std::vector<uint64_t> hits(rules_.size());
+  for (const auto &rule : rules_)
+    hits[rule.index] = statistics_.hits(rule.index);
+
+  for (size_t rule = 1; rule < rules_.size(); ++rule)
+    for (size_t position = rule;
+         position > 0 and
+         hits[rules_[position - 1].index] < hits[rules_[position].index] and
+         disjoint(rules_[position - 1], rules_[position]);
+         --position)
+      std::swap(rules_[position - 1], rules_[position]);
+#endif
+}
+
+MULTILOAD_HOT const configuration::rule *
+configuration::select(const binary_format &format,
+                      multiload::probe &probe) const noexcept {
+  const auto validate = format.decode(probe.base(), probe.size());
+  if (not validate)
+    return nullptr;
+
+  // the rules are consulted in order, reading more of the binary only once a
+  // rule which requires it has passed its screen
+  for (const auto &rule : rules_) {
+    if (rule.format != &format)
+      continue;
+    if (rule.extent > probe::extent::header and
+        (not validate(probe.base(), probe.size(), rule.screen) or
+         not probe.fetch(rule.extent)))
+      continue;
+    if (validate(probe.base(), probe.size(), rule.constraints) and
+        (not rule.native or
+         host::can_execute(elf::reader(probe.base(), probe.size()))))
+      return &rule;
+  }
+  return nullptr;
+}
+
+[[noreturn]] MULTILOAD_HOT void
+configuration::dispatch(const binary_format &format, int fd,
+                        multiload::probe &probe,
+                        char *argv[]) const noexcept {
   assert(not rules_.empty() && "configuration must be loaded first");
 
-  const auto &identifier = *reinterpret_cast<const elf::identifier *>(base);
-  const auto file_class =
-      identifier[static_cast<int>(elf::identifier_field::file_class)];
-  elf::machine machine_type = elf::machine::none;
-
-  switch (static_cast<const elf::file_class>(file_class)) {
-  case elf::file_class::none:
-    ::exit(EXIT_FAILURE);
-  case elf::file_class::class_32: {
-    const auto ehdr = *reinterpret_cast<const elf::header<32> *>(base);
-    machine_type = ehdr.machine_type;
+  const rule *selected = select(format, probe);
+  const uint8_t *base = probe.base();
+  if (selected) {
+    statistics_.hit(selected->index);
+  } else if (&format == &elf_format) {
+    if (const elf::reader image{ base, probe.size() })
+      statistics_.miss(image.machine());
   }
-  case elf::file_class::class_64: {
-    const auto ehdr = *reinterpret_cast<const elf::header<64> *>(base);
-    machine_type = ehdr.machine_type;
+
+  if (selected and selected->native)
+    host::execute(elf::reader(base, probe.size()), argv);
+
+  // prefer a build for the host over emulation when one is installed beside
+  // the binary; otherwise the loader of the rule is used
+  std::string variant;
+  if (selected and not selected->variant.empty() and
+      sibling(selected->variant, argv[1],
+              elf::reader(base, probe.size()).machine(), variant)) {
+    char *binary = argv[1];
+    argv[1] = &variant[0];
+    ::execve(argv[1], argv + 1, environ);
+    argv[1] = binary;
   }
+
+  // the admission of the rule limits the emulated executions of its binaries,
+  // including those which a parked loader serves
+  if (selected and selected->max_concurrent) {
+    uint64_t waited;
+    const auto outcome =
+        admission::acquire(selected->fingerprint, selected->max_concurrent,
+                           selected->queue_timeout, waited);
+    if (waited)
+      statistics_.waited(selected->index, waited,
+                         outcome == admission::outcome::timed_out);
+    if (outcome == admission::outcome::timed_out)
+      expired(argv[1], selected->loader);
   }
 
-  std::function<bool(const uint8_t *, const configuration::constraints &)>
-      validate;
-  std::string loader;
-
-  switch (machine_type) {
-  case elf::machine::none:
-    ::exit(EXIT_FAILURE);
-  case elf::machine::aarch64:
-    validate = arch::aarch64::validate;
-    break;
-  case elf::machine::arm:
-    validate = arch::arm::validate;
-    break;
-  case elf::machine::i386:
-    validate = arch::i386::validate;
-    break;
-  case elf::machine::x86_64:
-    validate = arch::x86_64::validate;
-    break;
+  // a binary which is executed repeatedly may be served by a parked loader
+  if (selected and not selected->forkserver.empty())
+    multiload::forkserver::execute(selected->forkserver, selected->forkable,
+                                   argv);
+
+  // the resource policy of the rule is meant for the loader, and neither for a
+  // binary which runs natively nor for its variant
+  if (selected)
+    selected->policy.apply();
+
+  // a rule listing several loaders runs the binary with the fastest of them
+  const std::string *loader = selected ? &selected->loader : nullptr;
+  size_t candidate = 0;
+  uint64_t key = 0;
+  if (selected and not selected->candidates.empty()) {
+    probe.fetch(probe::extent::notes);
+    key = runtimes::key(selected->loader, selected->candidates, fd, base,
+                        probe.size());
+    candidate = runtimes::choose(key, selected->candidates.size() + 1,
+                                 selected->explore);
+    if (candidate)
+      loader = &selected->candidates[candidate - 1];
   }
 
-  for (const auto &rule : rules_) {
-    if (validate(base, rule.constraints)) {
-      loader = rule.loader;
-      break;
-    }
+  multiload::validate_loader(format, base, loader ? *loader : std::string());
+
+  // the actions which follow the program headers wherever they lead need the
+  // binary in its entirety
+  if ((selected->readahead or selected->prefetch) and
+      &format == &elf_format and probe.fetch(probe::extent::image)) {
+    if (selected->readahead)
+      multiload::prefetch_segments(fd, base, probe.size(),
+                                   selected->readahead);
+    if (selected->prefetch)
+      multiload::prefetch_libraries(argv[0], base, probe.size(),
+                                    selected->sysroot, selected->prefetch);
+  }
+
+  // the loader reopens the very file which was inspected, avoiding another
+  // path walk and any race with the file being replaced
+  char descriptor[sizeof("/proc/self/fd/") + 10];
+  if (not selected->execfd.empty() and ::fcntl(fd, F_SETFD, 0) == 0) {
+    std::snprintf(descriptor, sizeof(descriptor), "/proc/self/fd/%d", fd);
+    argv[1] = descriptor;
   }
 
-  multiload::validate_loader(machine_type, loader);
-  ::execvpe(loader.c_str(), argv, environ);
+  if (not selected->candidates.empty())
+    runtimes::supervise(key, candidate, loader->c_str(), argv);
+
+  ::execvpe(loader->c_str(), argv, environ);
   __builtin_trap();
 }
 }
-
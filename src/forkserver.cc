@@ -0,0 +1,358 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/forkserver.hh"
+#include "multiload/host.hh"
+#include "multiload/scoped-file-descriptor.hh"
+
+#include "support/hash.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+constexpr const uint32_t magic = 0x53464c4d;  // MLFS
+constexpr const uint32_t version = 1;
+
+// the strings of an invocation are bounded well beyond ARG_MAX
+constexpr const uint64_t maximum_length = 64ull << 20;
+
+struct header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t arguments;
+  uint32_t environment;
+  uint64_t length;
+};
+
+union control {
+  struct cmsghdr align;
+  char buffer[CMSG_SPACE(sizeof(int) * multiload::forkserver::descriptors)];
+};
+
+bool write_all(int fd, const void *buffer, size_t length) noexcept {
+  const auto *cursor = static_cast<const char *>(buffer);
+  while (length) {
+    const ssize_t written = ::send(fd, cursor, length, MSG_NOSIGNAL);
+    if (written < 0 and errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    cursor = cursor + written;
+    length = length - written;
+  }
+  return true;
+}
+
+bool read_all(int fd, void *buffer, size_t length) noexcept {
+  auto *cursor = static_cast<char *>(buffer);
+  while (length) {
+    const ssize_t count = ::recv(fd, cursor, length, 0);
+    if (count < 0 and errno == EINTR)
+      continue;
+    if (count <= 0)
+      return false;
+    cursor = cursor + count;
+    length = length - count;
+  }
+  return true;
+}
+}
+
+namespace multiload {
+namespace forkserver {
+invocation::~invocation() noexcept {
+  for (const auto fd : descriptors)
+    if (fd >= 0)
+      ::close(fd);
+}
+
+std::string socket(const std::string &directory, const std::string &binary) {
+  static constexpr const char digits[] = "0123456789abcdef";
+
+  const uint64_t key = hash::fnv1a(binary);
+  std::string path = directory + "/";
+  for (int shift = 60; shift >= 0; shift -= 4)
+    path.push_back(digits[(key >> shift) & 0xf]);
+  return path;
+}
+
+bool admits(const std::vector<std::string> &binaries,
+            const std::string &binary) noexcept {
+  return std::any_of(binaries.begin(), binaries.end(),
+                     [&binary](const std::string &pattern) {
+                       return not ::fnmatch(pattern.c_str(), binary.c_str(), 0);
+                     });
+}
+
+bool send(int channel, const invocation &invocation) noexcept {
+  std::string strings;
+  for (const auto &argument : invocation.arguments)
+    strings.append(argument.c_str(), argument.length() + 1);
+  for (const auto &variable : invocation.environment)
+    strings.append(variable.c_str(), variable.length() + 1);
+
+  const struct header header = {
+    magic, version, static_cast<uint32_t>(invocation.arguments.size()),
+    static_cast<uint32_t>(invocation.environment.size()), strings.length(),
+  };
+
+  // the descriptors accompany the first byte of the header
+  union control control = {};
+  struct iovec iov = { const_cast<struct header *>(&header), sizeof(header) };
+  struct msghdr message = {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(invocation.descriptors));
+  std::memcpy(CMSG_DATA(cmsg), invocation.descriptors,
+              sizeof(invocation.descriptors));
+
+  ssize_t sent;
+  do
+    sent = ::sendmsg(channel, &message, MSG_NOSIGNAL);
+  while (sent < 0 and errno == EINTR);
+  if (sent <= 0)
+    return false;
+
+  return write_all(channel, reinterpret_cast<const char *>(&header) + sent,
+                   sizeof(header) - sent) and
+         write_all(channel, strings.data(), strings.length());
+}
+
+bool receive(int channel, invocation &invocation) noexcept {
+  struct header header;
+  union control control;
+  struct iovec iov = { &header, sizeof(header) };
+  struct msghdr message = {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  ssize_t received;
+  do
+    received = ::recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+  while (received < 0 and errno == EINTR);
+  if (received <= 0)
+    return false;
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg;
+       cmsg = CMSG_NXTHDR(&message, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET or cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    std::memcpy(invocation.descriptors, CMSG_DATA(cmsg),
+                std::min(count, descriptors) * sizeof(int));
+  }
+
+  if (message.msg_flags & MSG_CTRUNC or
+      std::any_of(std::begin(invocation.descriptors),
+                  std::end(invocation.descriptors),
+                  [](int fd) { return fd < 0; }))
+    return false;
+
+  if (not read_all(channel, reinterpret_cast<char *>(&header) + received,
+                   sizeof(header) - received) or
+      header.magic != magic or header.version != version or
+      header.length > maximum_length)
+    return false;
+
+  std::string strings(header.length, '\0');
+  if (not read_all(channel, &strings[0], strings.length()))
+    return false;
+
+  size_t offset = 0;
+  for (uint64_t index = 0;
+       index < uint64_t(header.arguments) + header.environment; ++index) {
+    const auto end = strings.find('\0', offset);
+    if (end == std::string::npos)
+      return false;
+    (index < header.arguments ? invocation.arguments : invocation.environment)
+        .emplace_back(strings, offset, end - offset);
+    offset = end + 1;
+  }
+
+  return offset == strings.length() and not invocation.arguments.empty();
+}
+
+bool send(int channel, const reply &reply) noexcept {
+  return write_all(channel, &reply, sizeof(reply));
+}
+
+bool receive(int channel, reply &reply) noexcept {
+  return read_all(channel, &reply, sizeof(reply));
+}
+
+void execute(const std::string &directory,
+             const std::vector<std::string> &binaries, char *argv[]) noexcept {
+  char binary[PATH_MAX];
+  if (not ::realpath(argv[1], binary) or not admits(binaries, binary))
+    return;
+
+  const std::string path = socket(directory, binary);
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.length() >= sizeof(address.sun_path))
+    return;
+  std::memcpy(address.sun_path, path.c_str(), path.length() + 1);
+
+  // the absence of a fork server is not an error; the binary is simply
+  // executed by the loader as usual
+  multiload::scoped_file_descriptor channel(::socket(AF_UNIX,
+                                                     SOCK_STREAM | SOCK_CLOEXEC,
+                                                     0));
+  if (channel < 0 or
+      ::connect(channel, reinterpret_cast<struct sockaddr *>(&address),
+                sizeof(address)) < 0)
+    return;
+
+  // the invocation carries the environment and descriptors of the caller, so
+  // it is only handed to a fork server of the same user (or of root)
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  if (::getsockopt(channel, SOL_SOCKET, SO_PEERCRED, &credentials,
+                   &length) < 0 or
+      (credentials.uid != ::geteuid() and credentials.uid != 0))
+    return;
+
+  // the invocation owns copies of the descriptors so that they remain intact
+  // if the fork server declines the invocation
+  invocation invocation;
+  for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd)
+    if ((invocation.descriptors[fd] = ::fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0)
+      return;
+  invocation.descriptors[3] = ::open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (invocation.descriptors[3] < 0)
+    return;
+
+  for (char **argument = argv + 1; *argument; ++argument)
+    invocation.arguments.emplace_back(*argument);
+  for (char **variable = environ; *variable; ++variable)
+    invocation.environment.emplace_back(*variable);
+
+  reply reply;
+  if (not send(channel, invocation) or not receive(channel, reply) or
+      reply.kind != reply::started)
+    return;
+
+  if (not receive(channel, reply) or reply.kind != reply::exited) {
+    std::cerr << "lost the fork server of '" << binary << "'" << std::endl;
+    ::exit(EXIT_FAILURE);
+  }
+
+  host::propagate(reply.status);
+}
+
+void park(int control, std::vector<std::string> &arguments) noexcept {
+  sigset_t mask, previous;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  ::sigprocmask(SIG_BLOCK, &mask, &previous);
+
+  multiload::scoped_file_descriptor signals(::signalfd(-1, &mask,
+                                                       SFD_CLOEXEC));
+  if (signals < 0 or not send(control, reply{ reply::ready, ::getpid(), 0 }))
+    ::exit(EXIT_FAILURE);
+
+  struct pollfd events[] = {
+    { control, POLLIN, 0 },
+    { signals, POLLIN, 0 },
+  };
+
+  for (;;) {
+    if (::poll(events, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      ::exit(EXIT_FAILURE);
+    }
+
+    if (events[1].revents & POLLIN) {
+      struct signalfd_siginfo info;
+      if (::read(signals, &info, sizeof(info)) < 0)
+        continue;
+
+      int status;
+      for (pid_t pid; (pid = ::waitpid(-1, &status, WNOHANG)) > 0;)
+        send(control, reply{ reply::exited, pid, status });
+    }
+
+    if (not (events[0].revents & (POLLIN | POLLHUP)))
+      continue;
+
+    // the daemon going away retires the parked loader
+    invocation invocation;
+    if (not receive(control, invocation))
+      ::exit(EXIT_SUCCESS);
+
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+      ::close(control);
+      ::sigprocmask(SIG_SETMASK, &previous, nullptr);
+
+      for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd)
+        if (::dup2(invocation.descriptors[fd], fd) < 0)
+          ::_exit(127);
+      if (::fchdir(invocation.descriptors[3]) < 0)
+        ::_exit(127);
+
+      ::clearenv();
+      for (const auto &variable : invocation.environment)
+        ::putenv(::strdup(variable.c_str()));
+
+      arguments = std::move(invocation.arguments);
+      return;
+    }
+
+    send(control, pid < 0 ? reply{ reply::refused, 0, errno }
+                          : reply{ reply::started, pid, 0 });
+  }
+}
+}
+}
@@ -0,0 +1,196 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/fragments.hh"
+#include "multiload/lexer.hh"
+#include "multiload/parser.hh"
+#include "multiload/scoped-file-descriptor.hh"
+#include "multiload/scoped-mmap.hh"
+#include "multiload/state.hh"
+
+#include "support/hash.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+constexpr const uint32_t magic = 0x52464c4d;  // MLFR
+constexpr const uint32_t version = 1;
+
+// the identity of the fragment which was compiled; the compiled rules follow
+struct header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  int64_t seconds;
+  int64_t nanoseconds;
+};
+
+bool unable(const char *action, const std::string &path) {
+  std::cerr << "unable to " << action << " '" << path << "': "
+            << std::strerror(errno) << std::endl;
+  return false;
+}
+
+header identify(const struct stat &st) noexcept {
+  return {
+    magic, version, static_cast<uint64_t>(st.st_dev),
+    static_cast<uint64_t>(st.st_ino), static_cast<uint64_t>(st.st_size),
+    static_cast<int64_t>(st.st_mtim.tv_sec),
+    static_cast<int64_t>(st.st_mtim.tv_nsec),
+  };
+}
+
+// each user keeps compilations of its own, which the others neither trust nor
+// attempt to replace
+std::string location(const header &hdr) {
+  uint64_t key = hash::fnv1a(&hdr.device, sizeof(hdr.device));
+  key = hash::fnv1a(&hdr.inode, sizeof(hdr.inode), key);
+  return multiload::state::location("fragment", key);
+}
+
+bool cached(const header &identity,
+            std::vector<multiload::configuration::rule> &rules) noexcept {
+  multiload::scoped_file_descriptor fd(::open(location(identity).c_str(),
+                                              O_RDONLY | O_CLOEXEC));
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 or not multiload::state::trusted(st) or
+      static_cast<size_t>(st.st_size) < sizeof(header))
+    return false;
+
+  std::vector<uint8_t> image(st.st_size);
+  if (::pread(fd, image.data(), image.size(), 0) != st.st_size or
+      std::memcmp(image.data(), &identity, sizeof(identity)))
+    return false;
+
+  return multiload::configuration::deserialize(image.data() + sizeof(header),
+                                               st.st_size - sizeof(header),
+                                               rules);
+}
+
+// the cache is an optimisation: failing to write it is not an error
+void cache(const header &identity,
+           const std::vector<multiload::configuration::rule> &rules) noexcept {
+  const std::string path = location(identity);
+  std::string temporary = path + ".XXXXXX";
+
+  const std::string image = multiload::configuration::serialize(rules);
+
+  int fd = ::mkostemp(&temporary[0], O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  if (::fchmod(fd, 0644) < 0 or
+      ::write(fd, &identity, sizeof(identity)) != sizeof(identity) or
+      ::write(fd, image.data(), image.size()) !=
+          static_cast<ssize_t>(image.size()) or
+      ::rename(temporary.c_str(), path.c_str()) < 0)
+    ::unlink(temporary.c_str());
+  ::close(fd);
+}
+}
+
+namespace multiload {
+namespace fragments {
+std::vector<std::string> enumerate(const std::string &file) {
+  std::vector<std::string> files;
+  if (::access(file.c_str(), F_OK) == 0)
+    files.push_back(file);
+
+  const std::string drop = file + ".d";
+  DIR *stream = ::opendir(drop.c_str());
+  if (not stream)
+    return files;
+
+  std::vector<std::string> names;
+  while (const struct dirent *entry = ::readdir(stream)) {
+    const size_t length = std::strlen(entry->d_name);
+    if (entry->d_name[0] == '.' or length <= 5 or
+        std::strcmp(entry->d_name + length - 5, ".conf"))
+      continue;
+    names.push_back(entry->d_name);
+  }
+  ::closedir(stream);
+
+  std::sort(names.begin(), names.end());
+  for (const auto &name : names)
+    files.push_back(drop + "/" + name);
+
+  return files;
+}
+
+bool load(const std::string &path,
+          std::vector<configuration::rule> &rules) noexcept {
+  multiload::scoped_file_descriptor fd(::open(path.c_str(),
+                                              O_RDONLY | O_CLOEXEC));
+  if (fd < 0)
+    return unable("open", path);
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0)
+    return unable("stat", path);
+
+  const header identity = identify(st);
+  if (cached(identity, rules))
+    return true;
+
+  rules.clear();
+  if (st.st_size) {
+    void *base = ::mmap(NULL, st.st_size, PROT_READ,
+                        MAP_PRIVATE | MAP_NONBLOCK | MAP_NORESERVE, fd, 0);
+    multiload::scoped_mmap mapping(base, st.st_size);
+    if (mapping == MAP_FAILED)
+      return unable("mmap", path);
+
+    multiload::lexer lexer(static_cast<const char *>(base), st.st_size);
+    multiload::parser parser(lexer);
+
+    rules = parser.parse();
+  }
+
+  cache(identity, rules);
+  return true;
+}
+}
+}
@@ -0,0 +1,247 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/host.hh"
+
+#include "elf/auxiliary.hh"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include <signal.h>
+#include <sys/auxv.h>
+#include <sys/personality.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+using auxiliary = elf::auxiliary<sizeof(void *) * 8>;
+
+// HWCAP_VFP on 32-bit ARM
+constexpr const unsigned long arm_hwcap_vfp = 1 << 6;
+
+enum capability : unsigned {
+  ia32 = 1 << 0,
+  aarch32 = 1 << 1,
+};
+
+unsigned long auxv(auxiliary::vector type) noexcept {
+  return ::getauxval(static_cast<unsigned long>(type));
+}
+
+bool exists(const char *path) noexcept {
+  struct stat st;
+  return ::stat(path, &st) == 0;
+}
+
+unsigned evaluate(elf::machine host) noexcept {
+  unsigned result = 0;
+
+  switch (host) {
+  default:
+    break;
+  case elf::machine::x86_64:
+    // only registered by kernels with CONFIG_IA32_EMULATION
+    if (exists("/proc/sys/abi/vsyscall32"))
+      result = result | ia32;
+    break;
+  case elf::machine::aarch64: {
+    // the kernel refuses the 32-bit personality unless the CPUs are able to
+    // execute AArch32 at EL0; the previous personality is restored
+    const int previous = ::personality(0xffffffff);
+    if (previous >= 0 and ::personality(PER_LINUX32) >= 0) {
+      result = result | aarch32;
+      ::personality(previous);
+    }
+    break;
+  }
+  }
+
+  return result;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+unsigned measure() noexcept {
+  unsigned eax, ebx, ecx, edx;
+
+  if (not __get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 1;
+  const unsigned features = ecx;
+
+  unsigned extended = 0;
+  if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx))
+    extended = ecx;
+
+  unsigned structured = 0;
+  if (__get_cpuid_max(0, nullptr) >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    structured = ebx;
+  }
+
+  // the register state which the kernel saves (XCR0)
+  unsigned long long state = 0;
+  if (features & bit_OSXSAVE) {
+    unsigned low, high;
+    __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    state = static_cast<unsigned long long>(high) << 32 | low;
+  }
+
+  const auto all = [](unsigned value, unsigned mask) {
+    return (value & mask) == mask;
+  };
+
+  // CMPXCHG16B, LAHF/SAHF, POPCNT, SSE3, SSE4.1, SSE4.2, SSSE3
+  if (not all(features, bit_CMPXCHG16B | bit_POPCNT | bit_SSE3 | bit_SSE4_1 |
+                            bit_SSE4_2 | bit_SSSE3) or
+      not all(extended, bit_LAHF_LM))
+    return 1;
+
+  // AVX, AVX2, BMI1, BMI2, F16C, FMA, LZCNT, MOVBE, OSXSAVE
+  if (not all(features, bit_AVX | bit_F16C | bit_FMA | bit_MOVBE |
+                            bit_OSXSAVE) or
+      not all(extended, bit_LZCNT) or
+      not all(structured, bit_AVX2 | bit_BMI | bit_BMI2) or
+      (state & 0x06) != 0x06)
+    return 2;
+
+  // AVX512F, AVX512BW, AVX512CD, AVX512DQ, AVX512VL
+  if (not all(structured, bit_AVX512F | bit_AVX512BW | bit_AVX512CD |
+                              bit_AVX512DQ | bit_AVX512VL) or
+      (state & 0xe6) != 0xe6)
+    return 3;
+
+  return 4;
+}
+#else
+unsigned measure() noexcept {
+  return 0;
+}
+#endif
+}
+
+namespace multiload {
+namespace host {
+elf::machine machine() noexcept {
+  const auto *platform =
+      reinterpret_cast<const char *>(auxv(auxiliary::vector::platform));
+  if (not platform)
+    return elf::machine::none;
+
+  if (std::strcmp(platform, "x86_64") == 0)
+    return elf::machine::x86_64;
+  if (std::strcmp(platform, "aarch64") == 0)
+    return elf::machine::aarch64;
+  // i386, i486, i586, i686
+  if (platform[0] == 'i' and std::strcmp(platform + 2, "86") == 0)
+    return elf::machine::i386;
+  // v5l, v6l, v7l, v8l
+  if (platform[0] == 'v' and std::strlen(platform) == 3 and platform[2] == 'l')
+    return elf::machine::arm;
+
+  return elf::machine::none;
+}
+
+unsigned isa_level() noexcept {
+  static const unsigned level = measure();
+  return level;
+}
+
+bool can_execute(elf::machine guest, bool big_endian) noexcept {
+  // evaluated once, which is safe from the workers of a batch or replay
+  static const unsigned capabilities = evaluate(machine());
+
+  const auto host = machine();
+
+  if (guest == host)
+    return true;
+
+  switch (guest) {
+  default:
+    return false;
+  case elf::machine::i386:
+    return host == elf::machine::x86_64 and capabilities & ia32;
+  case elf::machine::arm:
+    return host == elf::machine::aarch64 and capabilities & aarch32 and
+           not big_endian;
+  }
+}
+
+bool can_execute(const elf::reader &image) noexcept {
+  if (not can_execute(image.machine(), image.big_endian()))
+    return false;
+
+  // hard-float images require VFP
+  if (image.machine() == elf::machine::arm and
+      machine() == elf::machine::arm and
+      image.flags() & static_cast<uint32_t>(elf::flags::arm_abi_hard_float) and
+      not (auxv(auxiliary::vector::hardware_capabilities) & arm_hwcap_vfp))
+    return false;
+
+  // a static image can only be executed itself, which binfmt_misc would hand
+  // straight back to multiload
+  const char *interpreter = image.interpreter();
+  return interpreter and ::access(interpreter, X_OK) == 0;
+}
+
+bool secure() noexcept {
+  return auxv(auxiliary::vector::secure);
+}
+
+void execute(const elf::reader &image, char *argv[]) noexcept {
+  if (not image.wide() and host::machine() != image.machine())
+    ::personality(PER_LINUX32);
+
+  // argv[0] and argv[1] both name the image; the interpreter is not claimed
+  // by the entries which multiload registers (see multiload-register) and is
+  // handed the image as its first argument
+  const char *interpreter = image.interpreter();
+  argv[0] = const_cast<char *>(interpreter);
+  ::execve(interpreter, argv, environ);
+
+  std::cerr << "unable to execute '" << argv[1] << "' with '" << interpreter
+            << "': "
+            << std::strerror(errno) << std::endl;
+  ::exit(EXIT_FAILURE);
+}
+
+void propagate(int status) noexcept {
+  if (WIFSIGNALED(status)) {
+    ::signal(WTERMSIG(status), SIG_DFL);
+    ::raise(WTERMSIG(status));
+    ::exit(128 + WTERMSIG(status));
+  }
+  ::exit(WEXITSTATUS(status));
+}
+}
+}
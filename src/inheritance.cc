@@ -0,0 +1,143 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/inheritance.hh"
+#include "multiload/configuration.hh"
+#include "multiload/scoped-file-descriptor.hh"
+#include "multiload/scoped-mmap.hh"
+
+#include "support/hash.hh"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+constexpr const int seals =
+    F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+bool parse(const char *value, int &fd, uint64_t &generation,
+           uint64_t &checksum) noexcept {
+  char *end;
+
+  errno = 0;
+  const long descriptor = std::strtol(value, &end, 10);
+  if (errno or end == value or *end != ':' or descriptor < 0 or
+      descriptor > INT32_MAX)
+    return false;
+  fd = static_cast<int>(descriptor);
+
+  value = end + 1;
+  generation = std::strtoull(value, &end, 16);
+  if (errno or end == value or *end != ':')
+    return false;
+
+  value = end + 1;
+  checksum = std::strtoull(value, &end, 16);
+  return not errno and end != value and *end == '\0';
+}
+}
+
+namespace multiload {
+namespace inheritance {
+bool inherit(uint64_t generation, configuration &configuration) noexcept {
+  const char *value = std::getenv(variable);
+  if (not value)
+    return false;
+
+  int fd;
+  uint64_t published, checksum;
+  if (not parse(value, fd, published, checksum) or published != generation)
+    return false;
+
+  // only a memfd supports seals; a descriptor which has been reused for any
+  // other file is rejected here
+  const int sealed = ::fcntl(fd, F_GET_SEALS);
+  if (sealed < 0 or (sealed & seals) != seals)
+    return false;
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 or not S_ISREG(st.st_mode) or st.st_size == 0)
+    return false;
+
+  void *base = ::mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  multiload::scoped_mmap mapping(base, st.st_size);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  if (hash::fnv1a(base, st.st_size) != checksum)
+    return false;
+
+  return configuration.restore(mapping, st.st_size);
+}
+
+void bequeath(uint64_t generation, const std::string &image) noexcept {
+  // the descriptor is deliberately inherited across execution
+  multiload::scoped_file_descriptor fd(::memfd_create("multiload",
+                                                      MFD_ALLOW_SEALING));
+  if (fd < 0)
+    return;
+
+  if (::write(fd, image.data(), image.size()) !=
+          static_cast<ssize_t>(image.size()) or
+      ::fcntl(fd, F_ADD_SEALS, seals) < 0)
+    return;
+
+  // the image being replaced, which would otherwise be inherited by every
+  // descendant along with its replacement
+  int previous = -1;
+  uint64_t published, checksum;
+  if (const char *value = std::getenv(variable)) {
+    const int sealed = parse(value, previous, published, checksum)
+                           ? ::fcntl(previous, F_GET_SEALS)
+                           : -1;
+    if (previous == fd or sealed < 0 or (sealed & seals) != seals)
+      previous = -1;
+  }
+
+  char value[64];
+  std::snprintf(value, sizeof(value), "%d:%016" PRIx64 ":%016" PRIx64,
+                static_cast<int>(fd), generation,
+                hash::fnv1a(image.data(), image.size()));
+  if (::setenv(variable, value, 1) < 0)
+    return;
+
+  fd.release();
+  if (previous >= 0)
+    ::close(previous);
+}
+}
+}
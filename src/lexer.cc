@@ -29,6 +29,8 @@
 
 #include "multiload/lexer.hh"
 
+#include "support/compiler.hh"
+
 #include <cassert>
 
 using token = multiload::token;
@@ -44,7 +46,29 @@ static constexpr const char * const spelling[] = {
   [static_cast<int>(token::type::kw_subarch)] = "subarch",
   [static_cast<int>(token::type::kw_endian)] = "endian",
   [static_cast<int>(token::type::kw_flags)] = "flags",
+  [static_cast<int>(token::type::kw_format)] = "format",
+  [static_cast<int>(token::type::kw_interpreter)] = "interpreter",
   [static_cast<int>(token::type::kw_loader)] = "loader",
+  [static_cast<int>(token::type::kw_readahead)] = "readahead",
+  [static_cast<int>(token::type::kw_resident)] = "resident",
+  [static_cast<int>(token::type::kw_prefetch)] = "prefetch",
+  [static_cast<int>(token::type::kw_sysroot)] = "sysroot",
+  [static_cast<int>(token::type::kw_execfd)] = "execfd",
+  [static_cast<int>(token::type::kw_variant)] = "variant",
+  [static_cast<int>(token::type::kw_affinity)] = "affinity",
+  [static_cast<int>(token::type::kw_cgroup)] = "cgroup",
+  [static_cast<int>(token::type::kw_ioprio)] = "ioprio",
+  [static_cast<int>(token::type::kw_nice)] = "nice",
+  [static_cast<int>(token::type::kw_rlimit_as)] = "rlimit_as",
+  [static_cast<int>(token::type::kw_rlimit_nofile)] = "rlimit_nofile",
+  [static_cast<int>(token::type::kw_scheduler)] = "scheduler",
+  [static_cast<int>(token::type::kw_isa)] = "isa",
+  [static_cast<int>(token::type::kw_max_concurrent)] = "max_concurrent",
+  [static_cast<int>(token::type::kw_queue_timeout)] = "queue_timeout",
+  [static_cast<int>(token::type::kw_forkserver)] = "forkserver",
+  [static_cast<int>(token::type::kw_forkable)] = "forkable",
+  [static_cast<int>(token::type::kw_candidate)] = "candidate",
+  [static_cast<int>(token::type::kw_explore)] = "explore",
 };
 #else
 static constexpr const char * const spelling [] = {
@@ -59,7 +83,29 @@ static constexpr const char * const spelling [] = {
   /* kw_subarch */  "subarch",
   /* kw_endian */   "endian",
   /* kw_flags */    "flags",
+  /* kw_format */   "format",
+  /* kw_interpreter */ "interpreter",
   /* kw_loader */   "loader",
+  /* kw_readahead */ "readahead",
+  /* kw_resident */ "resident",
+  /* kw_prefetch */ "prefetch",
+  /* kw_sysroot */ "sysroot",
+  /* kw_execfd */ "execfd",
+  /* kw_variant */ "variant",
+  /* kw_affinity */ "affinity",
+  /* kw_cgroup */ "cgroup",
+  /* kw_ioprio */ "ioprio",
+  /* kw_nice */ "nice",
+  /* kw_rlimit_as */ "rlimit_as",
+  /* kw_rlimit_nofile */ "rlimit_nofile",
+  /* kw_scheduler */ "scheduler",
+  /* kw_isa */ "isa",
+  /* kw_max_concurrent */ "max_concurrent",
+  /* kw_queue_timeout */ "queue_timeout",
+  /* kw_forkserver */ "forkserver",
+  /* kw_forkable */ "forkable",
+  /* kw_candidate */ "candidate",
+  /* kw_explore */ "explore",
 };
 #endif
 
@@ -106,13 +152,13 @@ bool lexer::match() const noexcept {
 
 template <>
 token lexer::consume<token::type::literal>() noexcept {
-  using whitespace = set<' ', '\f', '\n', '\t', '\r', '\v'>;
+  using delimiter = set<' ', '\f', '\n', '\t', '\r', '\v', ';', '{', '}'>;
 
   const char *lexeme = cursor_;
 
   do
     ++cursor_, ++column_;
-  while (not whitespace::contains(*cursor_));
+  while (cursor_ < buffer_end_ and not delimiter::contains(*cursor_));
 
   return token(token::type::literal,
                std::experimental::string_view(lexeme, cursor_ - lexeme));
@@ -144,7 +190,7 @@ token lexer::consume<token::type::whitespace>() noexcept {
   return token();
 }
 
-token lexer::lex() noexcept {
+MULTILOAD_HOT token lexer::lex() noexcept {
   assert(cursor_ <= buffer_end_ && "cursor may not extend beyond buffer_end_");
   if (cursor_ == buffer_end_)
     return token();
@@ -163,18 +209,70 @@ token lexer::lex() noexcept {
   case 'a':
     if (match<token::type::kw_arch>())
       return consume<token::type::kw_arch>();
+    if (match<token::type::kw_affinity>())
+      return consume<token::type::kw_affinity>();
+  case 'c':
+    if (match<token::type::kw_cgroup>())
+      return consume<token::type::kw_cgroup>();
+    if (match<token::type::kw_candidate>())
+      return consume<token::type::kw_candidate>();
   case 'e':
     if (match<token::type::kw_endian>())
       return consume<token::type::kw_endian>();
+    if (match<token::type::kw_execfd>())
+      return consume<token::type::kw_execfd>();
+    if (match<token::type::kw_explore>())
+      return consume<token::type::kw_explore>();
   case 'f':
     if (match<token::type::kw_flags>())
       return consume<token::type::kw_flags>();
+    if (match<token::type::kw_format>())
+      return consume<token::type::kw_format>();
+    if (match<token::type::kw_forkserver>())
+      return consume<token::type::kw_forkserver>();
+    if (match<token::type::kw_forkable>())
+      return consume<token::type::kw_forkable>();
+  case 'i':
+    if (match<token::type::kw_interpreter>())
+      return consume<token::type::kw_interpreter>();
+    if (match<token::type::kw_ioprio>())
+      return consume<token::type::kw_ioprio>();
+    if (match<token::type::kw_isa>())
+      return consume<token::type::kw_isa>();
   case 'l':
     if (match<token::type::kw_loader>())
       return consume<token::type::kw_loader>();
+  case 'm':
+    if (match<token::type::kw_max_concurrent>())
+      return consume<token::type::kw_max_concurrent>();
+  case 'n':
+    if (match<token::type::kw_nice>())
+      return consume<token::type::kw_nice>();
+  case 'p':
+    if (match<token::type::kw_prefetch>())
+      return consume<token::type::kw_prefetch>();
+  case 'q':
+    if (match<token::type::kw_queue_timeout>())
+      return consume<token::type::kw_queue_timeout>();
+  case 'r':
+    if (match<token::type::kw_readahead>())
+      return consume<token::type::kw_readahead>();
+    if (match<token::type::kw_resident>())
+      return consume<token::type::kw_resident>();
+    if (match<token::type::kw_rlimit_as>())
+      return consume<token::type::kw_rlimit_as>();
+    if (match<token::type::kw_rlimit_nofile>())
+      return consume<token::type::kw_rlimit_nofile>();
   case 's':
     if (match<token::type::kw_subarch>())
       return consume<token::type::kw_subarch>();
+    if (match<token::type::kw_sysroot>())
+      return consume<token::type::kw_sysroot>();
+    if (match<token::type::kw_scheduler>())
+      return consume<token::type::kw_scheduler>();
+  case 'v':
+    if (match<token::type::kw_variant>())
+      return consume<token::type::kw_variant>();
   }
   return consume<token::type::literal>();
 }
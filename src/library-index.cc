@@ -0,0 +1,255 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/library-index.hh"
+#include "multiload/scoped-file-descriptor.hh"
+#include "multiload/state.hh"
+
+#include "support/hash.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+constexpr const uint32_t magic = 0x494c4c4d;  // MLLI
+constexpr const uint32_t version = 1;
+
+struct header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t stamp;
+  uint64_t count;
+  uint64_t strings;
+};
+
+struct entry {
+  uint32_t name;
+  uint32_t path;
+};
+
+std::string location(const std::string &sysroot) {
+  return multiload::state::location("libraries",
+                                    hash::fnv1a(sysroot, hash::fnv1a_basis));
+}
+
+uint64_t stamp(const std::string &path, uint64_t hash) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) < 0)
+    std::memset(&st, 0, sizeof(st));
+
+  hash = hash::fnv1a(path, hash);
+  hash = hash::fnv1a(&st.st_mtim, sizeof(st.st_mtim), hash);
+  return hash::fnv1a(&st.st_ino, sizeof(st.st_ino), hash);
+}
+
+// collect the directories named by an ld.so.conf, following its includes
+void configure(const std::string &sysroot, const std::string &file,
+               std::vector<std::string> &directories, uint64_t &hash,
+               unsigned depth) {
+  hash = stamp(sysroot + file, hash);
+
+  std::ifstream stream(sysroot + file);
+  for (std::string line; std::getline(stream, line);) {
+    line.erase(std::find(line.begin(), line.end(), '#'), line.end());
+
+    const auto begin = line.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+      continue;
+    line = line.substr(begin, line.find_last_not_of(" \t") - begin + 1);
+
+    if (line.compare(0, 8, "include ") == 0 or
+        line.compare(0, 8, "include\t") == 0) {
+      if (depth == 4)
+        continue;
+
+      std::string pattern = line.substr(line.find_first_not_of(" \t", 8));
+      if (pattern[0] != '/')
+        pattern = file.substr(0, file.rfind('/') + 1) + pattern;
+
+      glob_t matches;
+      if (::glob((sysroot + pattern).c_str(), 0, nullptr, &matches) == 0)
+        for (size_t match = 0; match < matches.gl_pathc; ++match)
+          configure(sysroot, matches.gl_pathv[match] + sysroot.length(),
+                    directories, hash, depth + 1);
+      ::globfree(&matches);
+      continue;
+    }
+
+    if (line[0] == '/' and
+        std::find(directories.begin(), directories.end(), line) ==
+            directories.end())
+      directories.push_back(line);
+  }
+}
+
+// the search path of the sysroot, in the order in which it is consulted,
+// along with a stamp which changes whenever any part of it is modified
+std::vector<std::string> search_path(const std::string &sysroot,
+                                     uint64_t &hash) {
+  std::vector<std::string> directories;
+  hash = hash::fnv1a_basis;
+
+  configure(sysroot, "/etc/ld.so.conf", directories, hash, 0);
+  for (const auto *path : multiload::library_index::defaults)
+    if (std::find(directories.begin(), directories.end(), path) ==
+        directories.end())
+      directories.push_back(path);
+
+  for (const auto &path : directories)
+    hash = stamp(sysroot + path, hash);
+  return directories;
+}
+
+bool shared_object(const char *name) noexcept {
+  const char *extension = std::strstr(name, ".so");
+  return extension and (extension[3] == '\0' or extension[3] == '.');
+}
+}
+
+namespace multiload {
+constexpr const char *const library_index::defaults[];
+
+library_index::~library_index() noexcept {
+  if (base_)
+    ::munmap(base_, size_);
+}
+
+bool library_index::open(const std::string &sysroot) noexcept {
+  uint64_t hash;
+  search_path(sysroot, hash);
+
+  multiload::scoped_file_descriptor fd(::open(location(sysroot).c_str(),
+                                              O_RDONLY | O_CLOEXEC));
+
+  // the index names the files which a dispatch opens, so that it must not be
+  // one which another user could have planted
+  struct stat st;
+  if (fd < 0 or ::fstat(fd, &st) < 0 or not multiload::state::trusted(st) or
+      static_cast<size_t>(st.st_size) < sizeof(header))
+    return false;
+
+  const size_t size = st.st_size;
+  void *base = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED)
+    return false;
+
+  const auto *hdr = static_cast<const header *>(base);
+  const auto *strings = static_cast<const char *>(base) + size;
+  if (hdr->magic != magic or hdr->version != version or hdr->stamp != hash or
+      hdr->count > (size - sizeof(header)) / sizeof(entry) or
+      hdr->strings != size - sizeof(header) - hdr->count * sizeof(entry) or
+      (hdr->strings and strings[-1] != '\0')) {
+    ::munmap(base, size);
+    return false;
+  }
+
+  base_ = base, size_ = size;
+  return true;
+}
+
+bool library_index::build(const std::string &sysroot) noexcept {
+  uint64_t hash;
+  const auto directories = search_path(sysroot, hash);
+
+  // the first directory providing a soname wins, as with the dynamic linker
+  std::map<std::string, std::string> libraries;
+  for (const auto &path : directories) {
+    DIR *handle = ::opendir((sysroot + path).c_str());
+    if (not handle)
+      continue;
+    while (const struct dirent *dirent = ::readdir(handle))
+      if (dirent->d_type != DT_DIR and shared_object(dirent->d_name))
+        libraries.emplace(dirent->d_name,
+                          sysroot + path + "/" + dirent->d_name);
+    ::closedir(handle);
+  }
+
+  std::vector<entry> entries;
+  std::string strings;
+  for (const auto &library : libraries) {
+    entries.push_back({ static_cast<uint32_t>(strings.size()), 0 });
+    strings.append(library.first).push_back('\0');
+    entries.back().path = strings.size();
+    strings.append(library.second).push_back('\0');
+  }
+
+  const header hdr = { magic, version, hash, entries.size(), strings.size() };
+
+  std::string temporary = location(sysroot) + ".XXXXXX";
+  multiload::scoped_file_descriptor fd(::mkostemp(&temporary[0], O_CLOEXEC));
+  if (fd < 0)
+    return false;
+
+  const size_t length = entries.size() * sizeof(entry);
+  if (::fchmod(fd, 0644) < 0 or
+      ::write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) or
+      ::write(fd, entries.data(), length) != static_cast<ssize_t>(length) or
+      ::write(fd, strings.data(), strings.size()) !=
+          static_cast<ssize_t>(strings.size()) or
+      ::rename(temporary.c_str(), location(sysroot).c_str()) < 0) {
+    ::unlink(temporary.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+const char *library_index::find(const char *soname) const noexcept {
+  if (not base_)
+    return nullptr;
+
+  const auto *hdr = static_cast<const header *>(base_);
+  const auto *entries = reinterpret_cast<const entry *>(hdr + 1);
+  const auto *strings = reinterpret_cast<const char *>(entries + hdr->count);
+
+  const auto *last = entries + hdr->count;
+  const auto *match = std::lower_bound(
+      entries, last, soname, [strings, hdr](const entry &entry, const char *name) {
+        return entry.name < hdr->strings and
+               std::strcmp(strings + entry.name, name) < 0;
+      });
+  if (match == last or match->name >= hdr->strings or
+      match->path >= hdr->strings or std::strcmp(strings + match->name, soname))
+    return nullptr;
+  return strings + match->path;
+}
+}
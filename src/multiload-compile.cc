@@ -0,0 +1,82 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "multiload/configuration.hh"
+
+namespace multiload {
+void print_help(const char *argv0) {
+  std::cerr << R"(multiload-compile - compile a configuration into C++
+Copyright 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+
+usage: )" << argv0 << R"( configuration output
+)";
+}
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    multiload::print_help(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  multiload::configuration configuration(argv[1]);
+  if (!configuration.load())
+    return EXIT_FAILURE;
+
+  const std::string image = configuration.serialize();
+
+  std::ofstream output(argv[2]);
+  output << "// generated by multiload-compile from " << argv[1]
+         << "; do not edit\n\n"
+         << "#include \"multiload/embedded.hh\"\n\n"
+         << "namespace multiload {\n"
+         << "namespace embedded {\n"
+         << "alignas(8) const uint8_t image[] = {";
+  for (size_t byte = 0; byte < image.size(); ++byte)
+    output << (byte % 12 ? " " : "\n  ") << "0x" << std::hex << std::setw(2)
+           << std::setfill('0')
+           << static_cast<unsigned>(static_cast<uint8_t>(image[byte])) << ",";
+  output << std::dec << "\n};\n\n"
+         << "const size_t size = sizeof(image);\n"
+         << "}\n"
+         << "}\n";
+
+  output.close();
+  if (not output) {
+    std::cerr << "unable to write '" << argv[2] << "'" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
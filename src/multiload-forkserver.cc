@@ -0,0 +1,362 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "multiload/binary-format.hh"
+#include "multiload/configuration.hh"
+#include "multiload/forkserver.hh"
+#include "multiload/probe.hh"
+#include "multiload/scoped-file-descriptor.hh"
+
+namespace multiload {
+void print_help(const char *argv0) {
+  std::cerr << R"(multiload-forkserver - run a binary from a parked loader
+Copyright 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+
+usage: )" << argv0 << R"( [options] binary
+
+  -c, --config FILE     read the rules from FILE
+
+The rule selecting the binary must name a forkserver directory and list the
+binary as forkable.  The loader is started with MULTILOAD_FORKSERVER naming its
+control channel and is expected to park on it.
+)";
+}
+
+struct client {
+  int fd;
+  pid_t pid;
+};
+
+class server {
+  const struct stat &binary_;
+  const int control_;
+  std::vector<client> clients_;
+
+  // relay the termination of an invocation to the client awaiting it
+  void deliver(const forkserver::reply &reply) {
+    const auto client =
+        std::find_if(clients_.begin(), clients_.end(),
+                     [&reply](const multiload::client &client) {
+                       return client.pid == reply.pid;
+                     });
+    if (client == clients_.end())
+      return;
+    forkserver::send(client->fd, reply);
+    ::close(client->fd);
+    clients_.erase(client);
+  }
+
+  // only the owner of the daemon may have invocations run on its behalf, and
+  // only of the binary which is parked
+  bool permitted(int fd, const forkserver::invocation &invocation) const {
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0 or
+        (credentials.uid != ::geteuid() and credentials.uid != 0))
+      return false;
+
+    struct stat st;
+    return ::fstatat(invocation.descriptors[3],
+                     invocation.arguments.front().c_str(), &st, 0) == 0 and
+           st.st_dev == binary_.st_dev and st.st_ino == binary_.st_ino;
+  }
+
+public:
+  server(const struct stat &binary, int control) noexcept
+      : binary_(binary), control_(control) {}
+
+  ~server() noexcept {
+    for (const auto &client : clients_) {
+      ::kill(client.pid, SIGTERM);
+      ::close(client.fd);
+    }
+  }
+
+  const std::vector<client> &clients() const noexcept {
+    return clients_;
+  }
+
+  void accept(int listener) {
+    const int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+
+    // a client which stalls must not hold up the others
+    const struct timeval timeout = { 1, 0 };
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    forkserver::invocation invocation;
+    forkserver::reply reply{ forkserver::reply::refused, 0, 0 };
+    if (forkserver::receive(fd, invocation) and permitted(fd, invocation) and
+        forkserver::send(control_, invocation)) {
+      while (forkserver::receive(control_, reply) and
+             reply.kind == forkserver::reply::exited)
+        deliver(reply);
+    }
+
+    if (not forkserver::send(fd, reply) or
+        reply.kind != forkserver::reply::started) {
+      if (reply.kind == forkserver::reply::started)
+        ::kill(reply.pid, SIGTERM);
+      ::close(fd);
+      return;
+    }
+
+    clients_.push_back({ fd, reply.pid });
+  }
+
+  bool relay() {
+    forkserver::reply reply;
+    if (not forkserver::receive(control_, reply))
+      return false;
+    if (reply.kind == forkserver::reply::exited)
+      deliver(reply);
+    return true;
+  }
+
+  // a client which goes away takes its invocation with it
+  void abandon(int fd) {
+    const auto client =
+        std::find_if(clients_.begin(), clients_.end(),
+                     [fd](const multiload::client &client) {
+                       return client.fd == fd;
+                     });
+    if (client == clients_.end())
+      return;
+    ::kill(client->pid, SIGTERM);
+    ::close(client->fd);
+    clients_.erase(client);
+  }
+};
+
+pid_t spawn(const std::string &loader, const std::string &binary,
+            int control) {
+  const pid_t pid = ::fork();
+  if (pid)
+    return pid;
+
+  sigset_t mask;
+  sigemptyset(&mask);
+  ::sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+  if (::fcntl(control, F_SETFD, 0) < 0 or
+      ::setenv("MULTILOAD_FORKSERVER", std::to_string(control).c_str(), 1) < 0)
+    ::_exit(127);
+
+  // the loader is started as though the binary had been executed directly
+  char *argv[] = {
+    const_cast<char *>(binary.c_str()),
+    const_cast<char *>(binary.c_str()),
+    nullptr,
+  };
+  ::execvp(loader.c_str(), argv);
+  ::_exit(127);
+}
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    { "config", required_argument, nullptr, 'c' },
+    { "help",   no_argument,       nullptr, 'h' },
+    { nullptr,  0,                 nullptr, 0   },
+  };
+
+  std::string file = SYSCONFDIR "/" "multiload.conf";
+
+  for (int option; (option = ::getopt_long(argc, argv, "c:h", options,
+                                           nullptr)) != -1;) {
+    switch (option) {
+    case 'c':
+      file = optarg;
+      break;
+    case 'h':
+      multiload::print_help(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      multiload::print_help(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind + 1 != argc) {
+    multiload::print_help(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  multiload::configuration configuration(file);
+  if (!configuration.load())
+    return EXIT_FAILURE;
+
+  char binary[PATH_MAX];
+  if (not ::realpath(argv[optind], binary)) {
+    std::cerr << "unable to resolve '" << argv[optind] << "': "
+              << std::strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  multiload::scoped_file_descriptor fd(::open(binary, O_RDONLY | O_CLOEXEC));
+  struct stat st;
+  if (fd < 0 or ::fstat(fd, &st) < 0) {
+    std::cerr << "unable to open '" << binary << "': " << std::strerror(errno)
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  multiload::probe probe(fd, st.st_size);
+  const auto *format =
+      probe.fetch(multiload::probe::extent::header)
+          ? multiload::identify(probe.base(), probe.size())
+          : nullptr;
+  const auto *rule = format ? configuration.select(*format, probe) : nullptr;
+  if (not rule or rule->forkserver.empty() or
+      not multiload::forkserver::admits(rule->forkable, binary)) {
+    std::cerr << "no rule serves '" << binary << "' from a fork server"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const std::string path =
+      multiload::forkserver::socket(rule->forkserver, binary);
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.length() >= sizeof(address.sun_path)) {
+    std::cerr << "socket path '" << path << "' is too long" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.length() + 1);
+
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  ::sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+  multiload::scoped_file_descriptor signals(::signalfd(-1, &mask,
+                                                       SFD_CLOEXEC));
+
+  int channel[2];
+  if (signals < 0 or
+      ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) < 0) {
+    std::cerr << "unable to create the control channel: "
+              << std::strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  multiload::scoped_file_descriptor control(channel[0]);
+  {
+    multiload::scoped_file_descriptor loader(channel[1]);
+    const pid_t pid = multiload::spawn(rule->loader, binary, loader);
+    if (pid < 0) {
+      std::cerr << "unable to start '" << rule->loader << "': "
+                << std::strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  multiload::forkserver::reply reply;
+  if (not multiload::forkserver::receive(control, reply) or
+      reply.kind != multiload::forkserver::reply::ready) {
+    std::cerr << "loader '" << rule->loader << "' did not park '" << binary
+              << "'" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // clients are only able to connect once the loader has parked
+  multiload::scoped_file_descriptor listener(
+      ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  ::unlink(path.c_str());
+  if (listener < 0 or
+      ::bind(listener, reinterpret_cast<struct sockaddr *>(&address),
+             sizeof(address)) < 0 or
+      ::listen(listener, SOMAXCONN) < 0) {
+    std::cerr << "unable to listen on '" << path << "': "
+              << std::strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  multiload::server server(st, control);
+  int status = EXIT_SUCCESS;
+  for (bool running = true; running;) {
+    std::vector<struct pollfd> events = {
+      { signals, POLLIN, 0 },
+      { listener, POLLIN, 0 },
+      { control, POLLIN, 0 },
+    };
+    for (const auto &client : server.clients())
+      events.push_back({ client.fd, POLLIN, 0 });
+
+    if (::poll(events.data(), events.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "poll failed: " << std::strerror(errno) << std::endl;
+      status = EXIT_FAILURE;
+      break;
+    }
+
+    if (events[0].revents & POLLIN)
+      running = false;
+
+    if (events[2].revents and not server.relay()) {
+      std::cerr << "loader '" << rule->loader << "' exited" << std::endl;
+      status = EXIT_FAILURE;
+      running = false;
+    }
+
+    // clients send nothing once their invocation has started
+    for (size_t index = 3; index < events.size(); ++index)
+      if (events[index].revents)
+        server.abandon(events[index].fd);
+
+    if (running and events[1].revents & POLLIN)
+      server.accept(listener);
+  }
+
+  ::unlink(path.c_str());
+  return status;
+}
@@ -0,0 +1,394 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/types.h>
+
+#include "multiload/architecture.hh"
+#include "multiload/binary-format.hh"
+#include "multiload/configuration.hh"
+#include "multiload/host.hh"
+
+#include "elf/types.hh"
+
+namespace multiload {
+void print_help(const char *argv0) {
+  std::cerr << R"(multiload-register - register multiload with binfmt_misc
+Copyright 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+
+usage: )" << argv0 << R"( [options]
+
+  -c, --config FILE   read the rules from FILE
+  -m, --mount DIR     binfmt_misc mount point (default: /proc/sys/fs/binfmt_misc)
+  -f, --flags FLAGS   flags for entries which bypass multiload (default: F)
+  -n, --dry-run       print the entries rather than registering them
+  -u, --unregister    remove all entries registered by multiload
+)";
+}
+
+namespace {
+constexpr const char prefix[] = "multiload-";
+
+struct entry {
+  std::string name;
+  std::string interpreter;
+  std::string flags;
+  std::string magic;
+  std::string mask;
+};
+
+// the ELF identifier, e_type and e_machine; e_type matches both ET_EXEC and
+// ET_DYN and EI_OSABI is ignored.  A dynamic entry only claims images whose
+// program headers follow the file header and begin with PT_PHDR, as those of
+// dynamically linked executables do: the interpreter of the architecture,
+// through which multiload executes images natively, is then not claimed, and
+// neither are static images, which the host executes itself.
+entry describe(const architecture &arch, bool big_endian, bool dynamic) {
+  std::string magic(20, '\0'), mask(20, '\xff');
+
+  std::memcpy(&magic[0], elf::magic, 4);
+  // architectures which use both classes match either
+  magic[static_cast<int>(elf::identifier_field::file_class)] =
+      static_cast<char>(arch.file_class);
+  if (arch.file_class == elf::file_class::none)
+    mask[static_cast<int>(elf::identifier_field::file_class)] = '\0';
+  magic[static_cast<int>(elf::identifier_field::data_encoding)] =
+      static_cast<char>(big_endian ? elf::data_encoding::msb
+                                   : elf::data_encoding::lsb);
+  magic[static_cast<int>(elf::identifier_field::file_version)] = 1;
+  mask[static_cast<int>(elf::identifier_field::os_abi)] = '\0';
+
+  const auto machine = static_cast<uint16_t>(arch.machine);
+  const auto type = static_cast<uint16_t>(elf::type::exec);
+  const int low = big_endian ? 1 : 0, high = big_endian ? 0 : 1;
+  magic[16 + low] = type & 0xff, magic[16 + high] = type >> 8;
+  mask[16 + low] = '\xfe';
+  magic[18 + low] = machine & 0xff, magic[18 + high] = machine >> 8;
+
+  if (dynamic and arch.file_class != elf::file_class::none) {
+    const bool wide = arch.file_class == elf::file_class::class_64;
+    const size_t size = wide ? sizeof(elf::header<64>)
+                             : sizeof(elf::header<32>);
+
+    const auto match = [&](size_t offset, uint64_t value, size_t width) {
+      if (magic.size() < offset + width)
+        magic.resize(offset + width, '\0'), mask.resize(offset + width, '\0');
+      for (size_t byte = 0; byte < width; ++byte) {
+        const size_t shift = 8 * (big_endian ? width - 1 - byte : byte);
+        magic[offset + byte] = static_cast<char>(value >> shift);
+        mask[offset + byte] = '\xff';
+      }
+    };
+
+    match(wide ? offsetof(elf::header<64>, program_header_offset)
+               : offsetof(elf::header<32>, program_header_offset),
+          size, wide ? 8 : 4);
+    match(size, static_cast<uint32_t>(elf::segment_type::program_header), 4);
+  }
+
+  return { std::string(prefix) + arch.name + (big_endian ? "-be" : ""), "",
+           "", magic, mask };
+}
+
+std::string escape(const std::string &bytes) {
+  std::ostringstream escaped;
+  for (const auto byte : bytes)
+    escaped << "\\x" << "0123456789abcdef"[(byte >> 4) & 0xf]
+            << "0123456789abcdef"[byte & 0xf];
+  return escaped.str();
+}
+
+std::string hex(const std::string &bytes) {
+  std::string result;
+  for (const auto byte : bytes) {
+    result.push_back("0123456789abcdef"[(byte >> 4) & 0xf]);
+    result.push_back("0123456789abcdef"[byte & 0xf]);
+  }
+  return result;
+}
+
+std::string registration(const entry &entry) {
+  return ":" + entry.name + ":M::" + escape(entry.magic) + ":" +
+         escape(entry.mask) + ":" + entry.interpreter + ":" + entry.flags;
+}
+
+// a rule may bypass multiload if it is selected purely on the ELF header and
+// it does not require any work of multiload before the loader is executed
+bool direct(const configuration::rule &rule) {
+  if (rule.format != &elf_format or rule.native or rule.readahead or
+      rule.prefetch or not rule.execfd.empty() or not rule.variant.empty() or
+      not rule.policy.empty() or rule.max_concurrent or
+      not rule.forkserver.empty() or not rule.candidates.empty())
+    return false;
+  for (const auto &constraint : rule.constraints)
+    if (constraint.key != "arch" and constraint.key != "endian")
+      return false;
+  return true;
+}
+
+bool selects(const configuration::rule &rule, const architecture &arch,
+             bool big_endian) {
+  if (rule.format != &elf_format)
+    return false;
+
+  bool named = false;
+  for (const auto &constraint : rule.constraints) {
+    if (constraint.key == "arch") {
+      if (constraint.value != arch.name)
+        return false;
+      named = true;
+    }
+    if (constraint.key == "endian" and
+        constraint.value != (big_endian ? "big" : "little"))
+      return false;
+  }
+  return named;
+}
+
+std::vector<entry> plan(const configuration &configuration,
+                        const std::string &flags) {
+  std::string multiload_flags;
+  if (flags.find('F') != std::string::npos)
+    multiload_flags = "F";
+
+  std::vector<entry> entries;
+  for (auto arch = begin_architectures(); arch != end_architectures(); ++arch) {
+    // binfmt_misc is consulted before the ELF loader: claiming the machine of
+    // the host would hand every native execution to multiload, including that
+    // of multiload itself, which the kernel fails with ELOOP
+    if (arch->machine == host::machine()) {
+      if (std::any_of(configuration.rules().begin(),
+                      configuration.rules().end(),
+                      [arch](const configuration::rule &rule) {
+                        return selects(rule, *arch, false) or
+                               selects(rule, *arch, true);
+                      }))
+        std::cerr << "warning: rules for the host architecture '"
+                  << arch->name << "' only apply to binaries executed "
+                  << "through ld-multiload" << std::endl;
+      continue;
+    }
+
+    for (const bool big_endian : { false, true }) {
+      // only consider the non-default byte order if a rule explicitly
+      // requests it
+      const bool preferred =
+          big_endian == (arch->endian == elf::data_encoding::msb);
+      if (not preferred and
+          not std::any_of(configuration.rules().begin(),
+                          configuration.rules().end(),
+                          [arch, big_endian](const configuration::rule &rule) {
+                            return selects(rule, *arch, big_endian) and
+                                   not selects(rule, *arch, not big_endian);
+                          }))
+        continue;
+
+      const configuration::rule *candidate = nullptr;
+      for (const auto &rule : configuration.rules()) {
+        if (selects(rule, *arch, big_endian)) {
+          candidate = &rule;
+          break;
+        }
+      }
+      if (not candidate)
+        continue;
+
+      // images which the host may execute natively must leave the interpreter
+      // of the architecture to the host
+      const bool dynamic =
+          host::can_execute(arch->machine, big_endian) and
+          std::any_of(configuration.rules().begin(),
+                      configuration.rules().end(),
+                      [arch, big_endian](const configuration::rule &rule) {
+                        return rule.native and
+                               selects(rule, *arch, big_endian);
+                      });
+
+      auto entry = describe(*arch, big_endian, dynamic);
+      if (direct(*candidate)) {
+        entry.interpreter = candidate->loader;
+        entry.flags = flags;
+      } else {
+        entry.interpreter = LIBDIR "/ld-multiload";
+        entry.flags = multiload_flags;
+      }
+      entries.push_back(entry);
+    }
+  }
+  return entries;
+}
+
+bool write(const std::string &path, const std::string &value) {
+  std::ofstream file(path);
+  file << value;
+  file.close();
+  if (not file) {
+    std::cerr << "unable to write '" << path << "': " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// compare the entry with the state reported by the kernel
+bool registered(const std::string &mount, const entry &entry) {
+  std::ifstream status(mount + "/" + entry.name);
+  if (not status)
+    return false;
+
+  std::string line, interpreter, flags, magic, mask;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 12, "interpreter ") == 0)
+      interpreter = line.substr(12);
+    else if (line.compare(0, 7, "flags: ") == 0)
+      flags = line.substr(7);
+    else if (line.compare(0, 6, "magic ") == 0)
+      magic = line.substr(6);
+    else if (line.compare(0, 5, "mask ") == 0)
+      mask = line.substr(5);
+  }
+
+  // the kernel reports each flag once, and C implies O
+  std::set<char> expected(entry.flags.begin(), entry.flags.end());
+  if (expected.count('C'))
+    expected.insert('O');
+
+  return interpreter == entry.interpreter and
+         std::set<char>(flags.begin(), flags.end()) == expected and
+         magic == hex(entry.magic) and mask == hex(entry.mask);
+}
+
+std::vector<std::string> installed(const std::string &mount) {
+  std::vector<std::string> names;
+  if (DIR *directory = ::opendir(mount.c_str())) {
+    while (const struct dirent *entry = ::readdir(directory))
+      if (std::strncmp(entry->d_name, prefix, sizeof(prefix) - 1) == 0)
+        names.push_back(entry->d_name);
+    ::closedir(directory);
+  }
+  return names;
+}
+}
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    { "config",     required_argument, nullptr, 'c' },
+    { "mount",      required_argument, nullptr, 'm' },
+    { "flags",      required_argument, nullptr, 'f' },
+    { "dry-run",    no_argument,       nullptr, 'n' },
+    { "unregister", no_argument,       nullptr, 'u' },
+    { "help",       no_argument,       nullptr, 'h' },
+    { nullptr,      0,                 nullptr, 0   },
+  };
+
+  std::string file = SYSCONFDIR "/" "multiload.conf";
+  std::string mount = "/proc/sys/fs/binfmt_misc";
+  std::string flags = "F";
+  bool dry_run = false;
+  bool unregister = false;
+
+  for (int option; (option = ::getopt_long(argc, argv, "c:m:f:nuh", options,
+                                           nullptr)) != -1;) {
+    switch (option) {
+    case 'c':
+      file = optarg;
+      break;
+    case 'm':
+      mount = optarg;
+      break;
+    case 'f':
+      flags = optarg;
+      if (flags.find_first_not_of("FOCP") != std::string::npos) {
+        std::cerr << "invalid flags '" << flags << "'" << std::endl;
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'n':
+      dry_run = true;
+      break;
+    case 'u':
+      unregister = true;
+      break;
+    case 'h':
+      multiload::print_help(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      multiload::print_help(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<multiload::entry> entries;
+  if (not unregister) {
+    multiload::configuration configuration(file);
+    if (!configuration.load())
+      return EXIT_FAILURE;
+    for (const auto &diagnostic : configuration.check())
+      std::cerr << "warning: " << diagnostic << std::endl;
+    entries = multiload::plan(configuration, flags);
+  }
+
+  if (dry_run) {
+    for (const auto &entry : entries)
+      std::cout << multiload::registration(entry) << '\n';
+    return EXIT_SUCCESS;
+  }
+
+  bool success = true;
+
+  // remove entries which are stale or no longer required
+  for (const auto &name : multiload::installed(mount)) {
+    bool current = false;
+    for (const auto &entry : entries)
+      if (entry.name == name and multiload::registered(mount, entry))
+        current = true;
+    if (not current)
+      success = multiload::write(mount + "/" + name, "-1") and success;
+  }
+
+  for (const auto &entry : entries)
+    if (not multiload::registered(mount, entry))
+      success = multiload::write(mount + "/register",
+                                 multiload::registration(entry)) and success;
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
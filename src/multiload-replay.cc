@@ -0,0 +1,335 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "multiload/binary-format.hh"
+#include "multiload/configuration.hh"
+#include "multiload/probe.hh"
+#include "multiload/scoped-file-descriptor.hh"
+#include "multiload/scoped-mmap.hh"
+
+// A corpus is a sequence of records, each of which is the path of a binary
+// and the leading bytes of it:
+//
+//   uint32_t path length, uint32_t probe length, path, probe
+//
+// with all integers in host byte order.
+
+namespace multiload {
+void print_help(const char *argv0) {
+  std::cerr << R"(multiload-replay - evaluate configurations against a corpus
+Copyright 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+
+usage: )" << argv0 << R"( [options] corpus configuration [configuration]
+       )" << argv0 << R"( --capture [--probe SIZE] corpus < paths
+
+  -j, --jobs N        replay on N threads (default: all CPUs)
+  -c, --capture       append the binaries named on stdin to the corpus
+  -p, --probe SIZE    capture SIZE leading bytes of each binary (default: 4096)
+)";
+}
+
+namespace {
+struct record {
+  const char *path;
+  uint32_t path_length;
+  const uint8_t *probe;
+  uint32_t probe_length;
+};
+
+int capture(const char *corpus, size_t probe) {
+  multiload::scoped_file_descriptor output(
+      ::open(corpus, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644));
+  if (output < 0) {
+    std::cerr << "unable to open '" << corpus << "': " << std::strerror(errno)
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<uint8_t> buffer(probe);
+  for (std::string path; std::getline(std::cin, path);) {
+    multiload::scoped_file_descriptor fd(::open(path.c_str(),
+                                                O_RDONLY | O_CLOEXEC));
+    if (fd < 0)
+      continue;
+
+    const ssize_t length = ::pread(fd, buffer.data(), buffer.size(), 0);
+    if (length <= 0)
+      continue;
+
+    const uint32_t header[] = { static_cast<uint32_t>(path.length()),
+                                static_cast<uint32_t>(length) };
+    std::string record(reinterpret_cast<const char *>(header), sizeof(header));
+    record.append(path);
+    record.append(reinterpret_cast<const char *>(buffer.data()), length);
+    if (::write(output, record.data(), record.size()) !=
+        static_cast<ssize_t>(record.size())) {
+      std::cerr << "unable to write '" << corpus << "': "
+                << std::strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
+bool index(const uint8_t *base, size_t size, std::vector<record> &records) {
+  for (size_t offset = 0; offset < size;) {
+    uint32_t header[2];
+    if (size - offset < sizeof(header))
+      return false;
+    std::memcpy(header, base + offset, sizeof(header));
+    offset = offset + sizeof(header);
+
+    if (size - offset < uint64_t(header[0]) + header[1])
+      return false;
+    records.push_back({ reinterpret_cast<const char *>(base + offset),
+                        header[0], base + offset + header[0], header[1] });
+    offset = offset + header[0] + header[1];
+  }
+  return true;
+}
+
+struct tally {
+  std::chrono::nanoseconds elapsed{ 0 };
+  uint64_t reads = 0;
+  uint64_t bytes = 0;
+};
+
+struct result {
+  std::vector<const configuration::rule *> decisions;
+  tally total;
+};
+
+// the decoders may read the whole probe window, so short records are copied
+// into a zero filled buffer; the reads which a dispatch would issue against
+// the binary are accounted against the captured prefix
+tally replay(const configuration &configuration,
+             const std::vector<record> &records, size_t begin, size_t end,
+             std::vector<const configuration::rule *> &decisions) {
+  uint8_t window[probe_length];
+  tally tally;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t index = begin; index < end; ++index) {
+    const auto &record = records[index];
+    const uint8_t *probe = record.probe;
+    if (record.probe_length < probe_length) {
+      std::memset(window, 0, sizeof(window));
+      std::memcpy(window, record.probe, record.probe_length);
+      probe = window;
+    }
+
+    multiload::probe view(probe, record.probe_length);
+    view.fetch(multiload::probe::extent::header);
+    const auto *format = identify(view.base(), view.size());
+    decisions[index] = format ? configuration.select(*format, view) : nullptr;
+
+    tally.reads = tally.reads + view.reads();
+    tally.bytes = tally.bytes + view.bytes();
+  }
+  tally.elapsed = std::chrono::steady_clock::now() - start;
+  return tally;
+}
+
+result evaluate(const configuration &configuration,
+                const std::vector<record> &records, unsigned jobs) {
+  result total;
+  total.decisions.resize(records.size());
+
+  // each thread records the decisions of a disjoint range of the corpus
+  std::vector<tally> tallies(jobs);
+  std::vector<std::thread> threads;
+  const size_t chunk = (records.size() + jobs - 1) / jobs;
+  for (unsigned job = 0; job < jobs; ++job) {
+    const size_t begin = std::min(records.size(), job * chunk);
+    const size_t end = std::min(records.size(), begin + chunk);
+    threads.emplace_back([&, begin, end, job]() {
+      tallies[job] = replay(configuration, records, begin, end,
+                            total.decisions);
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  for (const auto &tally : tallies) {
+    total.total.elapsed += tally.elapsed;
+    total.total.reads += tally.reads;
+    total.total.bytes += tally.bytes;
+  }
+
+  return total;
+}
+
+void report(const char *file, const configuration &configuration,
+            const std::vector<record> &records, const result &result) {
+  std::vector<uint64_t> hits(configuration.rules().size());
+  uint64_t misses = 0;
+  for (const auto *rule : result.decisions)
+    rule ? ++hits[rule->index] : ++misses;
+
+  const double count = records.empty() ? 1.0 : records.size();
+  std::cout << file << ": " << records.size() << " records, "
+            << double(result.total.elapsed.count()) / count
+            << " ns/dispatch, " << double(result.total.reads) / count
+            << " preads/dispatch, " << double(result.total.bytes) / count
+            << " bytes/dispatch\n";
+  for (const auto &rule : configuration.rules())
+    std::cout << "  rule " << rule.index << " (" << rule.loader
+              << "): " << hits[rule.index] << '\n';
+  std::cout << "  unmatched: " << misses << '\n';
+}
+}
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    { "jobs",    required_argument, nullptr, 'j' },
+    { "capture", no_argument,       nullptr, 'c' },
+    { "probe",   required_argument, nullptr, 'p' },
+    { "help",    no_argument,       nullptr, 'h' },
+    { nullptr,   0,                 nullptr, 0   },
+  };
+
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  bool capture = false;
+  size_t probe = 4096;
+
+  for (int option; (option = ::getopt_long(argc, argv, "j:cp:h", options,
+                                           nullptr)) != -1;) {
+    switch (option) {
+    case 'j':
+      jobs = std::max(1, std::atoi(optarg));
+      break;
+    case 'c':
+      capture = true;
+      break;
+    case 'p':
+      probe = std::max<long>(multiload::probe_length, std::atol(optarg));
+      break;
+    case 'h':
+      multiload::print_help(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      multiload::print_help(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (capture) {
+    if (argc - optind != 1) {
+      multiload::print_help(argv[0]);
+      return EXIT_FAILURE;
+    }
+    return multiload::capture(argv[optind], probe);
+  }
+
+  if (argc - optind < 2 or argc - optind > 3) {
+    multiload::print_help(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const char *corpus = argv[optind];
+  multiload::scoped_file_descriptor fd(::open(corpus, O_RDONLY | O_CLOEXEC));
+  if (fd < 0) {
+    std::cerr << "unable to open '" << corpus << "': "
+              << std::strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0) {
+    std::cerr << "unable to stat '" << corpus << "': "
+              << std::strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  void *base = st.st_size ? ::mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                   fd, 0)
+                          : nullptr;
+  multiload::scoped_mmap mapping(base, st.st_size);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "unable to mmap '" << corpus << "': "
+              << std::strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<multiload::record> records;
+  if (not multiload::index(mapping, st.st_size, records)) {
+    std::cerr << "'" << corpus << "' is truncated" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::unique_ptr<multiload::configuration>> configurations;
+  std::vector<multiload::result> results;
+  for (int arg = optind + 1; arg < argc; ++arg) {
+    configurations.emplace_back(new multiload::configuration(argv[arg]));
+    if (!configurations.back()->load())
+      return EXIT_FAILURE;
+    results.push_back(multiload::evaluate(*configurations.back(), records,
+                                          jobs));
+    multiload::report(argv[arg], *configurations.back(), records,
+                      results.back());
+  }
+
+  if (results.size() == 2) {
+    uint64_t changes = 0;
+    for (size_t index = 0; index < records.size(); ++index) {
+      const auto *before = results[0].decisions[index];
+      const auto *after = results[1].decisions[index];
+      if ((before ? before->loader : "") == (after ? after->loader : ""))
+        continue;
+
+      ++changes;
+      std::cout << "changed: "
+                << std::string(records[index].path,
+                               records[index].path_length)
+                << ": " << (before ? before->loader : "(none)") << " -> "
+                << (after ? after->loader : "(none)") << '\n';
+    }
+    std::cout << changes << " decisions changed\n";
+  }
+
+  return EXIT_SUCCESS;
+}
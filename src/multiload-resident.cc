@@ -0,0 +1,319 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "multiload/configuration.hh"
+#include "multiload/parser.hh"
+#include "multiload/scoped-file-descriptor.hh"
+
+namespace multiload {
+void print_help(const char *argv0) {
+  std::cerr << R"(multiload-resident - keep loaders resident in the page cache
+Copyright 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+
+usage: )" << argv0 << R"( [options]
+
+  -c, --config FILE     read the rules from FILE
+  -b, --budget SIZE     map at most SIZE bytes (default: 256M)
+  -l, --lock            mlock the mapped files
+  -i, --interval SECS   re-warm every SECS seconds (default: 60)
+  -s, --stats           warm the files, report residency and exit
+
+SIGUSR1 reports the resident bytes of each file on stdout.
+)";
+}
+
+class resident_file {
+  std::string path_;
+  void *base_;
+  size_t size_;
+
+public:
+  resident_file(const resident_file &) = delete;
+  resident_file &operator=(const resident_file &) = delete;
+
+  resident_file(resident_file &&other) noexcept
+      : path_(std::move(other.path_)), base_(other.base_), size_(other.size_) {
+    other.base_ = MAP_FAILED;
+  }
+
+  explicit resident_file(const std::string &path) noexcept
+      : path_(path), base_(MAP_FAILED), size_(0) {}
+
+  ~resident_file() noexcept {
+    if (base_ != MAP_FAILED)
+      ::munmap(base_, size_);
+  }
+
+  const std::string &path() const noexcept {
+    return path_;
+  }
+
+  size_t size() const noexcept {
+    return size_;
+  }
+
+  bool map(size_t &budget, bool lock) noexcept {
+    multiload::scoped_file_descriptor fd(::open(path_.c_str(),
+                                                O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+      std::cerr << "unable to open '" << path_ << "': "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+      std::cerr << "unable to stat '" << path_ << "': "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+
+    if (static_cast<size_t>(st.st_size) > budget) {
+      std::cerr << "not mapping '" << path_ << "': exceeds memory budget"
+                << std::endl;
+      return false;
+    }
+
+    size_ = st.st_size;
+    base_ = ::mmap(NULL, size_, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (base_ == MAP_FAILED) {
+      std::cerr << "unable to mmap '" << path_ << "': "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+
+    if (lock and ::mlock(base_, size_) < 0)
+      std::cerr << "unable to mlock '" << path_ << "': "
+                << std::strerror(errno) << std::endl;
+
+    budget = budget - size_;
+    return true;
+  }
+
+  size_t resident() const noexcept {
+    const size_t page_size = ::sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((size_ + page_size - 1) / page_size);
+    if (::mincore(base_, size_, pages.data()) < 0)
+      return 0;
+
+    size_t bytes = 0;
+    for (size_t page = 0; page < pages.size(); ++page)
+      if (pages[page] & 1)
+        bytes += std::min(page_size, size_ - page * page_size);
+    return bytes;
+  }
+
+  void warm() const noexcept {
+    const size_t page_size = ::sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((size_ + page_size - 1) / page_size);
+    if (::mincore(base_, size_, pages.data()) < 0)
+      return;
+
+    ::madvise(base_, size_, MADV_WILLNEED);
+
+    const volatile uint8_t *base = static_cast<const uint8_t *>(base_);
+    for (size_t page = 0; page < pages.size(); ++page)
+      if (not (pages[page] & 1))
+        (void)base[page * page_size];
+  }
+};
+
+void report(const std::vector<resident_file> &files) {
+  for (const auto &file : files)
+    std::cout << file.resident() << '\t' << file.size() << '\t' << file.path()
+              << '\n';
+  std::cout.flush();
+}
+
+int memory_pressure_monitor() noexcept {
+  // some 150ms of stall within a 2s window; the window is the minimum which
+  // unprivileged processes may request
+  static const char trigger[] = "some 150000 2000000";
+
+  int fd = ::open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  if (::write(fd, trigger, sizeof(trigger)) < 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    { "config",   required_argument, nullptr, 'c' },
+    { "budget",   required_argument, nullptr, 'b' },
+    { "lock",     no_argument,       nullptr, 'l' },
+    { "interval", required_argument, nullptr, 'i' },
+    { "stats",    no_argument,       nullptr, 's' },
+    { "help",     no_argument,       nullptr, 'h' },
+    { nullptr,    0,                 nullptr, 0   },
+  };
+
+  std::string file = SYSCONFDIR "/" "multiload.conf";
+  size_t budget = size_t(256) << 20;
+  bool lock = false;
+  int interval = 60;
+  bool stats = false;
+
+  for (int option; (option = ::getopt_long(argc, argv, "c:b:li:sh", options,
+                                           nullptr)) != -1;) {
+    switch (option) {
+    case 'c':
+      file = optarg;
+      break;
+    case 'b':
+      if (not multiload::parse_size(optarg, budget)) {
+        std::cerr << "invalid budget '" << optarg << "'" << std::endl;
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'l':
+      lock = true;
+      break;
+    case 'i': {
+      char *end;
+      const long seconds = std::strtol(optarg, &end, 10);
+      if (end == optarg or *end or seconds <= 0 or seconds > INT_MAX) {
+        std::cerr << "invalid interval '" << optarg << "'" << std::endl;
+        return EXIT_FAILURE;
+      }
+      interval = static_cast<int>(seconds);
+      break;
+    }
+    case 's':
+      stats = true;
+      break;
+    case 'h':
+      multiload::print_help(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      multiload::print_help(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  multiload::configuration configuration(file);
+  if (!configuration.load())
+    return EXIT_FAILURE;
+
+  std::vector<std::string> paths;
+  for (const auto &rule : configuration.rules()) {
+    if (rule.resident.empty())
+      continue;
+    paths.push_back(rule.loader);
+    paths.insert(paths.end(), rule.resident.begin(), rule.resident.end());
+  }
+
+  std::vector<multiload::resident_file> files;
+  for (const auto &path : paths) {
+    if (std::any_of(files.begin(), files.end(),
+                    [&path](const multiload::resident_file &file) {
+                      return file.path() == path;
+                    }))
+      continue;
+
+    multiload::resident_file resident(path);
+    if (resident.map(budget, lock))
+      files.push_back(std::move(resident));
+  }
+
+  if (stats) {
+    multiload::report(files);
+    return EXIT_SUCCESS;
+  }
+
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  ::sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+  multiload::scoped_file_descriptor signals(::signalfd(-1, &mask,
+                                                       SFD_CLOEXEC));
+  if (signals < 0) {
+    std::cerr << "unable to create signalfd: " << std::strerror(errno)
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  multiload::scoped_file_descriptor pressure(
+      multiload::memory_pressure_monitor());
+
+  struct pollfd events[] = {
+    { signals, POLLIN, 0 },
+    { pressure, POLLPRI, 0 },
+  };
+
+  for (;;) {
+    int ready = ::poll(events, pressure < 0 ? 1 : 2, interval * 1000);
+    if (ready < 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "poll failed: " << std::strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (events[0].revents & POLLIN) {
+      struct signalfd_siginfo info;
+      if (::read(signals, &info, sizeof(info)) != sizeof(info))
+        continue;
+      if (info.ssi_signo != SIGUSR1)
+        break;
+      multiload::report(files);
+    }
+
+    if (ready == 0 or events[1].revents & POLLPRI)
+      for (const auto &file : files)
+        file.warm();
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -27,77 +27,436 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **/
 
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <string>
+#include <vector>
 
 #include <fcntl.h>
-#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "multiload/admission.hh"
+#include "multiload/binary-format.hh"
 #include "multiload/configuration.hh"
+#include "multiload/embedded.hh"
+#include "multiload/host.hh"
+#include "multiload/inheritance.hh"
+#include "multiload/overlays.hh"
+#include "multiload/probe.hh"
 #include "multiload/scoped-file-descriptor.hh"
-#include "multiload/scoped-mmap.hh"
+#include "multiload/statistics.hh"
 
-#include "elf/types.hh"
+#include "support/compiler.hh"
+#include "support/hash.hh"
 
 namespace multiload {
-void print_help(const char *argv0) {
+MULTILOAD_COLD void print_help(const char *argv0) {
   std::cerr << R"(multiload - a loader dispatcher
 Copyright 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+
+usage: )" << argv0 << R"( [OPTIONS] binary [arguments...]
+       )" << argv0 << R"( [OPTIONS] --stats
+       )" << argv0 << R"( [OPTIONS] --check
+       )" << argv0 << R"( [OPTIONS] --batch FILE|- [--jobs N]
+
+options:
+  --config FILE     read the configuration from FILE
+  --overlay FILE    layer the rules of FILE over the configuration
+
+Overlays are also read from the colon separated list in MULTILOAD_CONFIG,
+after those given as options.
 )";
 }
+
+std::string escape(const std::string &value) {
+  std::string escaped;
+  for (const auto ch : value) {
+    switch (ch) {
+    case '\\': escaped += "\\\\"; break;
+    case '"': escaped += "\\\""; break;
+    case '\n': escaped += "\\n"; break;
+    default: escaped += ch; break;
+    }
+  }
+  return escaped;
 }
 
-int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    multiload::print_help(argv[0]);
+// emit the dispatch counters in the prometheus text exposition format
+MULTILOAD_COLD int print_statistics(const configuration &configuration) {
+  multiload::statistics statistics;
+  if (not statistics.open(configuration.fingerprint(),
+                          configuration.rules().size(), false)) {
+    std::cerr << "no statistics have been recorded for the configuration"
+              << std::endl;
     return EXIT_FAILURE;
   }
 
-  // TODO(compnerd) support arguments
+  std::cout << "# HELP multiload_dispatches_total "
+               "Binaries dispatched by each rule.\n"
+               "# TYPE multiload_dispatches_total counter\n";
+  for (const auto &rule : configuration.rules())
+    std::cout << "multiload_dispatches_total{rule=\"" << rule.index
+              << "\",loader=\"" << escape(rule.loader) << "\"} "
+              << statistics.hits(rule.index) << '\n';
 
-  multiload::configuration configuration(SYSCONFDIR "/" "multiload.conf");
-  if (!configuration.load())
-    return EXIT_FAILURE;
+  std::cout << "# HELP multiload_misses_total "
+               "ELF binaries without a matching rule by machine.\n"
+               "# TYPE multiload_misses_total counter\n";
+  for (size_t machine = 0; machine < statistics::machines; ++machine)
+    if (const auto misses = statistics.misses(machine))
+      std::cout << "multiload_misses_total{machine=\""
+                << (machine + 1 == statistics::machines
+                        ? std::string("other") : std::to_string(machine))
+                << "\"} " << misses << '\n';
+
+  std::vector<const configuration::rule *> admitted;
+  for (const auto &rule : configuration.rules())
+    if (rule.max_concurrent)
+      admitted.push_back(&rule);
+  if (admitted.empty())
+    return EXIT_SUCCESS;
+
+  const auto label = [](const configuration::rule &rule) {
+    return "{rule=\"" + std::to_string(rule.index) + "\",loader=\"" +
+           escape(rule.loader) + "\"} ";
+  };
+
+  std::cout << "# HELP multiload_admission_running "
+               "Processes holding an admission slot.\n"
+               "# TYPE multiload_admission_running gauge\n";
+  for (const auto *rule : admitted)
+    std::cout << "multiload_admission_running" << label(*rule)
+              << admission::inspect(rule->fingerprint).running << '\n';
 
+  std::cout << "# HELP multiload_admission_queue_depth "
+               "Dispatches waiting for an admission slot.\n"
+               "# TYPE multiload_admission_queue_depth gauge\n";
+  for (const auto *rule : admitted)
+    std::cout << "multiload_admission_queue_depth" << label(*rule)
+              << admission::inspect(rule->fingerprint).waiting << '\n';
+
+  std::cout << "# HELP multiload_admission_waits_total "
+               "Dispatches which waited for an admission slot.\n"
+               "# TYPE multiload_admission_waits_total counter\n";
+  for (const auto *rule : admitted)
+    std::cout << "multiload_admission_waits_total" << label(*rule)
+              << statistics.waits(rule->index) << '\n';
+
+  std::cout << "# HELP multiload_admission_wait_seconds_total "
+               "Time spent waiting for admission slots.\n"
+               "# TYPE multiload_admission_wait_seconds_total counter\n";
+  for (const auto *rule : admitted)
+    std::cout << "multiload_admission_wait_seconds_total" << label(*rule)
+              << statistics.wait_time(rule->index) / 1e9 << '\n';
+
+  std::cout << "# HELP multiload_admission_timeouts_total "
+               "Dispatches abandoned waiting for an admission slot.\n"
+               "# TYPE multiload_admission_timeouts_total counter\n";
+  for (const auto *rule : admitted)
+    std::cout << "multiload_admission_timeouts_total" << label(*rule)
+              << statistics.timeouts(rule->index) << '\n';
+
+  return EXIT_SUCCESS;
+}
+
+// report the rules which are shadowed by, or overlap, rules of other files
+MULTILOAD_COLD int print_diagnostics(const configuration &configuration) {
+  const auto diagnostics = configuration.check();
+  for (const auto &diagnostic : diagnostics)
+    std::cout << diagnostic << '\n';
+  return diagnostics.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+MULTILOAD_COLD int unable(const char *action, const char *path) {
+  std::cerr << "unable to " << action << " '" << path << "': "
+            << std::strerror(errno) << std::endl;
+  return EXIT_FAILURE;
+}
+
+MULTILOAD_COLD int unrecognized(const char *path) {
+  std::cerr << "'" << path << "' is not a recognized binary format"
+            << std::endl;
+  return EXIT_FAILURE;
+}
+
+// dispatch argv[1], only returning if the binary cannot be dispatched
+int execute(const configuration &configuration, char *argv[]) {
   multiload::scoped_file_descriptor fd(::open(argv[1], O_RDONLY | O_CLOEXEC));
-  if (fd < 0) {
-    std::cerr << "unable to open '" << argv[1] << "': "
-              << std::strerror(errno) << std::endl;
-    return EXIT_FAILURE;
-  }
+  if (fd < 0)
+    return unable("open", argv[1]);
 
   struct stat st;
-  if (::fstat(fd, &st) < 0) {
-    std::cerr << "unable to stat '" << argv[1] << "': "
-              << std::strerror(errno) << std::endl;
-    return EXIT_FAILURE;
+  if (::fstat(fd, &st) < 0)
+    return unable("stat", argv[1]);
+
+  // only as much of the binary is read as the rules consulted require
+  multiload::probe probe(fd, st.st_size);
+  if (not probe.fetch(multiload::probe::extent::header))
+    return unable("read", argv[1]);
+
+  const auto *format = multiload::identify(probe.base(), probe.size());
+  if (not format)
+    return unrecognized(argv[1]);
+
+  // NOTE(compnerd) hide the fact that multiload was ever in the picture
+  argv[0] = argv[1];
+  configuration.dispatch(*format, fd, probe, argv);
+
+  __builtin_trap();
+}
+
+// split a record into arguments on whitespace; quotes group an argument
+bool split(const char *record, std::vector<std::string> &arguments) {
+  static constexpr const char whitespace[] = " \t\r\n";
+
+  arguments.clear();
+  for (const char *cursor = record; *cursor;) {
+    if (std::strchr(whitespace, *cursor)) {
+      ++cursor;
+      continue;
+    }
+
+    std::string argument;
+    char quote = '\0';
+    for (; *cursor and (quote or not std::strchr(whitespace, *cursor));
+         ++cursor) {
+      if (quote and *cursor == quote)
+        quote = '\0';
+      else if (not quote and (*cursor == '"' or *cursor == '\''))
+        quote = *cursor;
+      else
+        argument.push_back(*cursor);
+    }
+    if (quote)
+      return false;
+    arguments.push_back(argument);
   }
+  return true;
+}
+
+double seconds(const struct timespec &time) noexcept {
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+double seconds(const struct timeval &time) noexcept {
+  return time.tv_sec + time.tv_usec / 1e6;
+}
 
-  void *base = ::mmap(NULL, st.st_size, PROT_READ,
-                      MAP_PRIVATE | MAP_NONBLOCK | MAP_NORESERVE, fd, 0);
-  multiload::scoped_mmap mapping(base, st.st_size);
-  if (mapping == MAP_FAILED) {
-    std::cerr << "unable to mmap '" << argv[1] << "': "
+// run each command of the batch through the already compiled configuration,
+// reporting a tab separated line for each command as it completes
+int run_batch(const configuration &configuration, const char *source,
+              unsigned long jobs) {
+  const bool standard_input = std::strcmp(source, "-") == 0;
+  FILE *records = standard_input ? stdin : std::fopen(source, "re");
+  if (not records) {
+    std::cerr << "unable to open '" << source << "': "
               << std::strerror(errno) << std::endl;
     return EXIT_FAILURE;
   }
 
-  static_assert(sizeof(elf::magic) - 1 == sizeof(uint32_t),
-                "type-punning will truncate magic");
-  if (not (*reinterpret_cast<const uint32_t *>(base) ==
-           *reinterpret_cast<const uint32_t *>(elf::magic))) {
-    std::cerr << "'" << argv[1] << "' is not an ELF module" << std::endl;
-    return EXIT_FAILURE;
+  struct job {
+    size_t index;
+    std::string command;
+    struct timespec start;
+  };
+  std::map<pid_t, job> running;
+  bool failed = false;
+
+  const auto reap = [&running, &failed]() {
+    int status;
+    struct rusage usage;
+    const pid_t pid = ::wait4(-1, &status, 0, &usage);
+    if (pid < 0)
+      return false;
+
+    struct timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+
+    const auto completed = running.find(pid);
+    if (completed == running.end())
+      return true;
+
+    const auto &job = completed->second;
+    const int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    const int signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    failed = failed or code != 0;
+
+    std::cout << job.index << '\t' << code << '\t' << signal << '\t'
+              << std::fixed << std::setprecision(6)
+              << seconds(now) - seconds(job.start) << '\t'
+              << seconds(usage.ru_utime) << '\t' << seconds(usage.ru_stime)
+              << '\t' << usage.ru_maxrss << '\t' << job.command << std::endl;
+
+    running.erase(completed);
+    return true;
+  };
+
+  std::cout << "# index\tstatus\tsignal\twall\tuser\tsystem\tmaxrss\tcommand"
+            << std::endl;
+
+  char *line = nullptr;
+  size_t capacity = 0;
+  std::vector<std::string> arguments;
+  for (size_t index = 0; ::getline(&line, &capacity, records) >= 0; ++index) {
+    if (not split(line, arguments)) {
+      std::cerr << "unterminated quote in command " << index << std::endl;
+      failed = true;
+      continue;
+    }
+    if (arguments.empty())
+      continue;
+
+    while (running.size() >= jobs and reap())
+      ;
+
+    std::string command(line);
+    command.erase(command.find_last_not_of("\r\n") + 1);
+
+    struct timespec start;
+    ::clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // dispatch inspects the binary and may prefetch before the exec, which is
+    // not permissible in a vfork child
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+      std::cerr << "unable to fork: " << std::strerror(errno) << std::endl;
+      failed = true;
+      break;
+    }
+
+    if (pid == 0) {
+      // the commands must not consume the batch, nor move its offset: a child
+      // which exits rather than executing the command repositions the
+      // descriptor of the stream to the position at which it was forked
+      const int records_fd = ::fileno(records);
+      const int null = ::open("/dev/null", O_RDONLY);
+      if (null >= 0 and null != records_fd) {
+        ::dup3(null, records_fd, standard_input ? 0 : O_CLOEXEC);
+        ::close(null);
+      }
+
+      std::vector<char *> argv(1);
+      for (auto &argument : arguments)
+        argv.push_back(&argument[0]);
+      argv.push_back(nullptr);
+      ::_exit(execute(configuration, argv.data()));
+    }
+
+    running.emplace(pid, job{ index, command, start });
   }
 
-  // NOTE(compnerd) hide the fact that multiload was ever in the picture
-  argv[0] = argv[1];
-  configuration.dispatch(mapping, argv);
+  while (not running.empty() and reap())
+    ;
 
-  __builtin_trap();
+  std::free(line);
+  if (not standard_input)
+    std::fclose(records);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    multiload::print_help(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // the arguments and environment of a privileged execution are those of its
+  // invoker, whose configuration does not apply
+  const bool secure = multiload::host::secure();
+
+  const char *file = nullptr;
+  std::vector<const char *> overlays;
+  while (std::strcmp(argv[1], "--config") == 0 or
+         std::strcmp(argv[1], "--overlay") == 0) {
+    if (not argv[2] or not argv[3]) {
+      multiload::print_help(argv[0]);
+      return EXIT_FAILURE;
+    }
+    if (not secure) {
+      if (std::strcmp(argv[1], "--config") == 0)
+        file = argv[2];
+      else
+        overlays.push_back(argv[2]);
+    }
+    argv = argv + 2;
+  }
+
+#if defined(MULTILOAD_EMBEDDED_CONFIGURATION)
+  multiload::configuration configuration(file ? file : "<embedded>");
+#else
+  multiload::configuration configuration(file ? file
+                                              : SYSCONFDIR "/" "multiload.conf");
+#endif
+
+  for (const auto *overlay : overlays)
+    configuration.overlay(overlay);
+  if (not secure)
+    if (const char *list = std::getenv("MULTILOAD_CONFIG"))
+      for (const auto &overlay : multiload::overlays::enumerate(list))
+        configuration.overlay(overlay);
+
+  // a check reports on the files of the configuration, which only a load of
+  // the configuration itself retains
+  const bool inheritable = not secure and std::strcmp(argv[1], "--check");
+  uint64_t generation = 0;
+  if (inheritable) {
+    generation = configuration.generation();
+#if defined(MULTILOAD_EMBEDDED_CONFIGURATION)
+    if (not file)
+      generation = hash::fnv1a(multiload::embedded::image,
+                               multiload::embedded::size, generation);
+#endif
+  }
+
+  if (not inheritable or
+      not multiload::inheritance::inherit(generation, configuration)) {
+#if defined(MULTILOAD_EMBEDDED_CONFIGURATION)
+    if (!(file ? configuration.load()
+               : configuration.load(multiload::embedded::image,
+                                    multiload::embedded::size)))
+      return EXIT_FAILURE;
+#else
+    if (!configuration.load())
+      return EXIT_FAILURE;
+#endif
+
+    if (inheritable)
+      multiload::inheritance::bequeath(generation, configuration.serialize());
+  }
+
+  if (std::strcmp(argv[1], "--stats") == 0)
+    return multiload::print_statistics(configuration);
+
+  if (std::strcmp(argv[1], "--check") == 0)
+    return multiload::print_diagnostics(configuration);
 
+  const char *batch = nullptr;
+  unsigned long jobs = 1;
+  if (std::strcmp(argv[1], "--batch") == 0) {
+    if (not argv[2] or
+        (argv[3] and (std::strcmp(argv[3], "--jobs") or not argv[4] or
+                      not (jobs = std::strtoul(argv[4], nullptr, 10))))) {
+      multiload::print_help(argv[0]);
+      return EXIT_FAILURE;
+    }
+    batch = argv[2];
+  }
+
+  configuration.compile();
+
+  if (batch)
+    return multiload::run_batch(configuration, batch, jobs);
+
+  return multiload::execute(configuration, argv);
+}
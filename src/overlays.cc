@@ -0,0 +1,239 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/overlays.hh"
+#include "multiload/lexer.hh"
+#include "multiload/parser.hh"
+#include "multiload/scoped-file-descriptor.hh"
+#include "multiload/scoped-mmap.hh"
+#include "multiload/state.hh"
+
+#include "support/hash.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <utility>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+constexpr const uint32_t magic = 0x4f434c4d;  // MLCO
+constexpr const uint32_t version = 1;
+
+// an entry is marked as used at most once per interval, so that a job does
+// not write to the cache on every dispatch
+constexpr const time_t interval = 60;  // s
+
+// the content which was compiled; the compiled rules follow
+struct header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint64_t size;
+};
+
+bool unable(const char *action, const std::string &path) {
+  std::cerr << "unable to " << action << " '" << path << "': "
+            << std::strerror(errno) << std::endl;
+  return false;
+}
+
+// each user keeps a cache of its own, which the others neither trust nor are
+// able to evict from
+std::string location(const header &hdr) {
+  return multiload::state::location("overlay", hdr.hash);
+}
+
+bool cached(const header &identity,
+            std::vector<multiload::configuration::rule> &rules) noexcept {
+  multiload::scoped_file_descriptor fd(::open(location(identity).c_str(),
+                                              O_RDONLY | O_CLOEXEC));
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 or not multiload::state::trusted(st) or
+      static_cast<size_t>(st.st_size) < sizeof(header))
+    return false;
+
+  std::vector<uint8_t> image(st.st_size);
+  if (::pread(fd, image.data(), image.size(), 0) != st.st_size or
+      std::memcmp(image.data(), &identity, sizeof(identity)) or
+      not multiload::configuration::deserialize(image.data() + sizeof(header),
+                                                st.st_size - sizeof(header),
+                                                rules))
+    return false;
+
+  // the modification time of the entry orders the cache by recency of use
+  if (std::time(nullptr) - st.st_mtim.tv_sec > interval)
+    ::futimens(fd, nullptr);
+
+  return true;
+}
+
+// remove the least recently used entries beyond the capacity of the cache;
+// a reader which has opened an entry is unaffected by its removal
+void evict() noexcept {
+  // the entries of the user are named <directory>/<prefix><hash>
+  const std::string base = multiload::state::location("overlay");
+  const auto separator = base.rfind('/');
+  const std::string directory = base.substr(0, separator);
+  const std::string prefix = base.substr(separator + 1) + "-";
+
+  multiload::scoped_file_descriptor dfd(::open(directory.c_str(),
+                                               O_RDONLY | O_DIRECTORY |
+                                                   O_CLOEXEC));
+  if (dfd < 0)
+    return;
+
+  DIR *stream = ::fdopendir(::dup(dfd));
+  if (not stream)
+    return;
+
+  std::vector<std::pair<struct timespec, std::string>> entries;
+  while (const struct dirent *entry = ::readdir(stream)) {
+    // skip other caches and entries which are still being written
+    if (std::strncmp(entry->d_name, prefix.c_str(), prefix.length()) or
+        std::strchr(entry->d_name, '.'))
+      continue;
+
+    // a file planted under the name of an entry cannot be removed
+    struct stat st;
+    if (::fstatat(dfd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 and
+        st.st_uid == ::geteuid())
+      entries.emplace_back(st.st_mtim, entry->d_name);
+  }
+  ::closedir(stream);
+
+  if (entries.size() <= multiload::overlays::capacity)
+    return;
+
+  const auto excess = entries.begin() + (entries.size() -
+                                         multiload::overlays::capacity);
+  std::partial_sort(entries.begin(), excess, entries.end(),
+                    [](const std::pair<struct timespec, std::string> &lhs,
+                       const std::pair<struct timespec, std::string> &rhs) {
+                      return std::make_pair(lhs.first.tv_sec,
+                                            lhs.first.tv_nsec) <
+                             std::make_pair(rhs.first.tv_sec,
+                                            rhs.first.tv_nsec);
+                    });
+  for (auto entry = entries.begin(); entry != excess; ++entry)
+    ::unlinkat(dfd, entry->second.c_str(), 0);
+}
+
+// the cache is an optimisation: failing to write it is not an error
+void cache(const header &identity,
+           const std::vector<multiload::configuration::rule> &rules) noexcept {
+  const std::string path = location(identity);
+  std::string temporary = path + ".XXXXXX";
+
+  const std::string image = multiload::configuration::serialize(rules);
+
+  int fd = ::mkostemp(&temporary[0], O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  const bool published =
+      ::fchmod(fd, 0644) == 0 and
+      ::write(fd, &identity, sizeof(identity)) == sizeof(identity) and
+      ::write(fd, image.data(), image.size()) ==
+          static_cast<ssize_t>(image.size()) and
+      ::rename(temporary.c_str(), path.c_str()) == 0;
+  if (not published)
+    ::unlink(temporary.c_str());
+  ::close(fd);
+
+  if (published)
+    evict();
+}
+}
+
+namespace multiload {
+namespace overlays {
+std::vector<std::string> enumerate(const char *list) {
+  std::vector<std::string> overlays;
+  for (const char *begin = list; *begin;) {
+    const char *end = std::strchr(begin, ':');
+    if (not end)
+      end = begin + std::strlen(begin);
+    if (end != begin)
+      overlays.emplace_back(begin, end);
+    begin = *end ? end + 1 : end;
+  }
+  return overlays;
+}
+
+bool load(const std::string &path,
+          std::vector<configuration::rule> &rules) noexcept {
+  multiload::scoped_file_descriptor fd(::open(path.c_str(),
+                                              O_RDONLY | O_CLOEXEC));
+  if (fd < 0)
+    return unable("open", path);
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0)
+    return unable("stat", path);
+
+  rules.clear();
+  if (st.st_size == 0)
+    return true;
+
+  void *base = ::mmap(NULL, st.st_size, PROT_READ,
+                      MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+  multiload::scoped_mmap mapping(base, st.st_size);
+  if (mapping == MAP_FAILED)
+    return unable("mmap", path);
+
+  const header identity = {
+    magic, version, hash::fnv1a(base, st.st_size),
+    static_cast<uint64_t>(st.st_size),
+  };
+  if (cached(identity, rules))
+    return true;
+
+  multiload::lexer lexer(static_cast<const char *>(base), st.st_size);
+  multiload::parser parser(lexer);
+
+  rules = parser.parse();
+
+  cache(identity, rules);
+  return true;
+}
+}
+}
@@ -30,10 +30,57 @@
 #include "multiload/parser.hh"
 #include "multiload/lexer.hh"
 
+#include "support/compiler.hh"
+
 #include <cassert>
+#include <cstdlib>
 #include <iostream>
 
 namespace multiload {
+bool parse_size(const char *value, size_t &size) noexcept {
+  char *suffix;
+  const unsigned long long bytes = std::strtoull(value, &suffix, 0);
+  if (suffix == value)
+    return false;
+
+  unsigned shift;
+  switch (*suffix) {
+  default: return false;
+  case '\0': shift = 0; break;
+  case 'K': shift = 10; break;
+  case 'M': shift = 20; break;
+  case 'G': shift = 30; break;
+  }
+  if (*suffix and suffix[1])
+    return false;
+
+  size = bytes << shift;
+  return true;
+}
+
+std::string parser::parse_value() {
+  lexer_.next();
+
+  if (not lexer_.head().is<token::type::literal>())
+    __builtin_trap();
+  token value = lexer_.next();
+
+  if (lexer_.head().is<token::type::semi>())
+    lexer_.next();
+
+  return std::string(value.value().data(), value.value().length());
+}
+
+size_t parser::parse_size() {
+  const std::string value = parse_value();
+
+  size_t size;
+  if (not multiload::parse_size(value.c_str(), size))
+    __builtin_trap();
+
+  return size;
+}
+
 configuration::constraint parser::parse_constraint() {
   switch (lexer_.head()) {
   default: __builtin_trap();
@@ -41,17 +88,77 @@ configuration::constraint parser::parse_constraint() {
   case token::type::kw_subarch:
   case token::type::kw_endian:
   case token::type::kw_flags:
-    token key = lexer_.next();
-
-    if (not lexer_.head().is<token::type::literal>())
-      __builtin_trap();
-    token value = lexer_.next();
-
-    if (lexer_.head().is<token::type::semi>())
-      lexer_.next();
-
+  case token::type::kw_format:
+  case token::type::kw_interpreter:
+  case token::type::kw_isa:
+    token key = lexer_.head();
     return { std::string(key.value().data(), key.value().length()),
-             std::string(value.value().data(), value.value().length()) };
+             parse_value() };
+  }
+}
+
+void parser::parse_directive(configuration::rule &rule) {
+  switch (lexer_.head()) {
+  default:
+    rule.constraints.push_back(parse_constraint());
+    break;
+  case token::type::kw_readahead:
+    rule.readahead = parse_size();
+    break;
+  case token::type::kw_resident:
+    rule.resident.push_back(parse_value());
+    break;
+  case token::type::kw_sysroot:
+    rule.sysroot = parse_value();
+    break;
+  case token::type::kw_prefetch:
+    rule.prefetch = parse_size();
+    break;
+  case token::type::kw_execfd:
+    rule.execfd = parse_value();
+    break;
+  case token::type::kw_variant:
+    rule.variant = parse_value();
+    break;
+  case token::type::kw_affinity:
+    rule.policy.affinity = parse_value();
+    break;
+  case token::type::kw_scheduler:
+    rule.policy.scheduler = parse_value();
+    break;
+  case token::type::kw_nice:
+    rule.policy.nice = parse_value();
+    break;
+  case token::type::kw_ioprio:
+    rule.policy.ioprio = parse_value();
+    break;
+  case token::type::kw_cgroup:
+    rule.policy.cgroup = parse_value();
+    break;
+  case token::type::kw_rlimit_as:
+    rule.policy.address_space = parse_size();
+    break;
+  case token::type::kw_rlimit_nofile:
+    rule.policy.files = parse_size();
+    break;
+  case token::type::kw_max_concurrent:
+    rule.max_concurrent = parse_size();
+    break;
+  case token::type::kw_queue_timeout:
+    rule.queue_timeout = parse_size();
+    break;
+  case token::type::kw_forkserver:
+    rule.forkserver = parse_value();
+    break;
+  case token::type::kw_forkable:
+    rule.forkable.push_back(parse_value());
+    break;
+  case token::type::kw_candidate:
+    rule.candidates.push_back(parse_value());
+    break;
+  case token::type::kw_explore:
+    rule.explore = parse_size();
+    break;
   }
 }
 
@@ -71,7 +178,7 @@ configuration::rule parser::parse_rule() {
   lexer_.next();
 
   do
-    rule.constraints.push_back(parse_constraint());
+    parse_directive(rule);
   while (not lexer_.head().is<token::type::r_brace>() and
          not lexer_.head().is<token::type::eof>());
 
@@ -81,7 +188,7 @@ configuration::rule parser::parse_rule() {
   return rule;
 }
 
-std::vector<configuration::rule> parser::parse() {
+MULTILOAD_HOT std::vector<configuration::rule> parser::parse() {
   std::vector<configuration::rule> rules;
   while (lexer_.head().is<token::type::kw_loader>())
     rules.push_back(parse_rule());
@@ -0,0 +1,195 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/policy.hh"
+
+#include "support/compiler.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+// linux/ioprio.h
+constexpr const int ioprio_class_shift = 13;
+constexpr const int ioprio_class_realtime = 1;
+constexpr const int ioprio_class_best_effort = 2;
+constexpr const int ioprio_class_idle = 3;
+constexpr const int ioprio_who_process = 1;
+
+bool number(const std::string &value, long &result) {
+  if (value.empty())
+    return false;
+  char *end;
+  errno = 0;
+  result = std::strtol(value.c_str(), &end, 10);
+  return errno == 0 and *end == '\0';
+}
+
+// a cpu list as accepted by taskset -c, where node:N names the CPUs of a NUMA
+// node
+bool cpus(const std::string &list, cpu_set_t &set, bool nodes) {
+  for (size_t begin = 0, end; begin <= list.length(); begin = end + 1) {
+    end = std::min(list.find(',', begin), list.length());
+    const std::string item = list.substr(begin, end - begin);
+
+    long first, last;
+    if (nodes and item.compare(0, 5, "node:") == 0) {
+      if (not number(item.substr(5), first) or first < 0)
+        return false;
+
+      std::string contents;
+      std::ifstream node("/sys/devices/system/node/node" +
+                         std::to_string(first) + "/cpulist");
+      if (not std::getline(node, contents) or
+          not cpus(contents, set, false))
+        return false;
+      continue;
+    }
+
+    const auto range = item.find('-');
+    if (not number(item.substr(0, range), first) or
+        not number(range == std::string::npos ? item.substr(0, range)
+                                              : item.substr(range + 1),
+                   last) or
+        first < 0 or last < first or last >= CPU_SETSIZE)
+      return false;
+    for (long cpu = first; cpu <= last; ++cpu)
+      CPU_SET(cpu, &set);
+  }
+  return true;
+}
+
+void limit(int resource, rlim_t value) noexcept {
+  struct rlimit limits;
+  if (::getrlimit(resource, &limits) < 0)
+    return;
+  limits.rlim_max = std::min(limits.rlim_max, value);
+  limits.rlim_cur = limits.rlim_max;
+  ::setrlimit(resource, &limits);
+}
+}
+
+namespace multiload {
+bool policy::resolve(std::string &error) {
+  if (not affinity.empty()) {
+    CPU_ZERO(&affinity_);
+    if (not cpus(affinity, affinity_, true) or CPU_COUNT(&affinity_) == 0) {
+      error = "invalid affinity '" + affinity + "'";
+      return false;
+    }
+    pinned_ = true;
+  }
+
+  if (not scheduler.empty()) {
+    if (scheduler == "other")
+      scheduler_ = SCHED_OTHER;
+    else if (scheduler == "batch")
+      scheduler_ = SCHED_BATCH;
+    else if (scheduler == "idle")
+      scheduler_ = SCHED_IDLE;
+    else {
+      error = "unsupported scheduler '" + scheduler + "'";
+      return false;
+    }
+  }
+
+  if (not nice.empty()) {
+    long priority;
+    if (not number(nice, priority) or priority < -20 or priority > 19) {
+      error = "invalid nice value '" + nice + "'";
+      return false;
+    }
+    priority_ = priority, reniced_ = true;
+  }
+
+  if (not ioprio.empty()) {
+    const auto separator = ioprio.find(':');
+    const std::string name = ioprio.substr(0, separator);
+
+    long level = 4;
+    int cls;
+    if (name == "realtime")
+      cls = ioprio_class_realtime;
+    else if (name == "best-effort")
+      cls = ioprio_class_best_effort;
+    else if (name == "idle")
+      cls = ioprio_class_idle, level = 0;
+    else
+      cls = 0;
+
+    if (not cls or
+        (separator != std::string::npos and
+         (cls == ioprio_class_idle or
+          not number(ioprio.substr(separator + 1), level))) or
+        level < 0 or level > 7) {
+      error = "invalid ioprio '" + ioprio + "'";
+      return false;
+    }
+    ioprio_ = cls << ioprio_class_shift | level;
+  }
+
+  return true;
+}
+
+MULTILOAD_HOT void policy::apply() const noexcept {
+  // the policy is best effort: the binary is still run if it cannot be applied
+  if (not cgroup.empty()) {
+    const std::string procs =
+        (cgroup[0] == '/' ? cgroup : "/sys/fs/cgroup/" + cgroup) +
+        "/cgroup.procs";
+    const int fd = ::open(procs.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      (void)::write(fd, "0", 1);
+      ::close(fd);
+    }
+  }
+  if (pinned_)
+    ::sched_setaffinity(0, sizeof(affinity_), &affinity_);
+  if (scheduler_ >= 0) {
+    const struct sched_param parameters = { 0 };
+    ::sched_setscheduler(0, scheduler_, &parameters);
+  }
+  if (reniced_)
+    ::setpriority(PRIO_PROCESS, 0, priority_);
+  if (ioprio_ >= 0)
+    ::syscall(SYS_ioprio_set, ioprio_who_process, 0, ioprio_);
+  if (address_space)
+    limit(RLIMIT_AS, address_space);
+  if (files)
+    limit(RLIMIT_NOFILE, files);
+}
+}
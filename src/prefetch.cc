@@ -0,0 +1,381 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/prefetch.hh"
+#include "multiload/library-index.hh"
+#include "multiload/scoped-file-descriptor.hh"
+#include "multiload/scoped-mmap.hh"
+
+#include "elf/reader.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+size_t readahead(int fd, uint64_t offset, uint64_t length, size_t size,
+                 size_t budget) noexcept {
+  if (offset >= size or budget == 0)
+    return 0;
+
+  length = std::min<uint64_t>({ length, size - offset, budget });
+  if (::readahead(fd, offset, length) < 0)
+    ::posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+  return length;
+}
+
+// schedule the PT_LOAD segments of the image, the segment containing the entry
+// point first, returning the number of bytes requested
+size_t schedule(int fd, const elf::reader &image, size_t budget) noexcept {
+  const size_t initial = budget;
+  const auto entry_point = image.entry_point();
+  const auto segments = image.segments();
+
+  size_t primary = segments;
+  for (size_t index = 0; index < segments; ++index) {
+    const auto segment = image.segment(index);
+    if (segment.type != static_cast<uint32_t>(elf::segment_type::load))
+      continue;
+    if (entry_point - segment.virtual_address < segment.file_size) {
+      primary = index;
+      budget -= readahead(fd, segment.offset, segment.file_size, image.size(),
+                          budget);
+      break;
+    }
+  }
+
+  for (size_t index = 0; index < segments and budget; ++index) {
+    const auto segment = image.segment(index);
+    if (index == primary or
+        segment.type != static_cast<uint32_t>(elf::segment_type::load))
+      continue;
+    budget -= readahead(fd, segment.offset, segment.file_size, image.size(),
+                        budget);
+  }
+
+  return initial - budget;
+}
+
+class deadline {
+  struct timespec expiry_;
+
+public:
+  explicit deadline(long nanoseconds) noexcept {
+    ::clock_gettime(CLOCK_MONOTONIC, &expiry_);
+    expiry_.tv_nsec = expiry_.tv_nsec + nanoseconds;
+    expiry_.tv_sec = expiry_.tv_sec + expiry_.tv_nsec / 1000000000;
+    expiry_.tv_nsec = expiry_.tv_nsec % 1000000000;
+  }
+
+  bool expired() const noexcept {
+    struct timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > expiry_.tv_sec or
+           (now.tv_sec == expiry_.tv_sec and now.tv_nsec >= expiry_.tv_nsec);
+  }
+};
+
+// the file offset of a virtual address within a PT_LOAD segment
+bool translate(const elf::reader &image, uint64_t address,
+               uint64_t &offset) noexcept {
+  for (size_t index = 0, segments = image.segments(); index < segments;
+       ++index) {
+    const auto segment = image.segment(index);
+    if (segment.type != static_cast<uint32_t>(elf::segment_type::load) or
+        address - segment.virtual_address >= segment.file_size)
+      continue;
+    offset = segment.offset + (address - segment.virtual_address);
+    return offset < image.size();
+  }
+  return false;
+}
+
+struct dependencies {
+  std::vector<std::string> needed;
+  std::vector<std::string> search;
+};
+
+// read DT_NEEDED and DT_RUNPATH (or DT_RPATH) of the image; $ORIGIN expands to
+// the directory containing the image and all other paths are within sysroot
+bool enumerate(const elf::reader &image, const std::string &origin,
+               const std::string &sysroot, dependencies &dependencies) {
+  const uint8_t *dynamic = nullptr;
+  size_t entries = 0;
+  for (size_t index = 0, segments = image.segments(); index < segments;
+       ++index) {
+    const auto segment = image.segment(index);
+    if (segment.type != static_cast<uint32_t>(elf::segment_type::dynamic))
+      continue;
+    if (segment.offset >= image.size())
+      return false;
+    dynamic = image.base() + segment.offset;
+    entries = std::min<uint64_t>(segment.file_size,
+                                 image.size() - segment.offset) /
+              (image.wide() ? sizeof(elf::dynamic<64>)
+                            : sizeof(elf::dynamic<32>));
+    break;
+  }
+  if (not dynamic)
+    return false;
+
+  uint64_t strtab = 0, strsz = 0, runpath = 0, rpath = 0;
+  bool has_runpath = false, has_rpath = false;
+  std::vector<uint64_t> needed;
+  for (size_t index = 0; index < entries; ++index) {
+    int64_t tag;
+    uint64_t value;
+    if (image.wide()) {
+      const auto *entry =
+          reinterpret_cast<const elf::dynamic<64> *>(dynamic) + index;
+      tag = image.word<int64_t>(reinterpret_cast<const uint8_t *>(&entry->tag));
+      value =
+          image.word<uint64_t>(reinterpret_cast<const uint8_t *>(&entry->value));
+    } else {
+      const auto *entry =
+          reinterpret_cast<const elf::dynamic<32> *>(dynamic) + index;
+      tag = image.word<int32_t>(reinterpret_cast<const uint8_t *>(&entry->tag));
+      value =
+          image.word<uint32_t>(reinterpret_cast<const uint8_t *>(&entry->value));
+    }
+
+    switch (static_cast<elf::dynamic_tag>(tag)) {
+    default: break;
+    case elf::dynamic_tag::null: index = entries; break;
+    case elf::dynamic_tag::needed: needed.push_back(value); break;
+    case elf::dynamic_tag::string_table: strtab = value; break;
+    case elf::dynamic_tag::string_table_size: strsz = value; break;
+    case elf::dynamic_tag::runpath: runpath = value, has_runpath = true; break;
+    case elf::dynamic_tag::rpath: rpath = value, has_rpath = true; break;
+    }
+  }
+
+  uint64_t offset;
+  if (not translate(image, strtab, offset))
+    return false;
+  strsz = std::min<uint64_t>(strsz, image.size() - offset);
+  const auto *strings = reinterpret_cast<const char *>(image.base() + offset);
+
+  const auto string = [strings, strsz](uint64_t index, std::string &value) {
+    if (index >= strsz)
+      return false;
+    const void *end = std::memchr(strings + index, '\0', strsz - index);
+    if (not end)
+      return false;
+    value.assign(strings + index, static_cast<const char *>(end));
+    return true;
+  };
+
+  std::string value;
+  for (const auto index : needed)
+    if (string(index, value) and not value.empty())
+      dependencies.needed.push_back(value);
+
+  // DT_RUNPATH supersedes DT_RPATH
+  if ((has_runpath and string(runpath, value)) or
+      (not has_runpath and has_rpath and string(rpath, value))) {
+    for (size_t begin = 0, end; begin <= value.length(); begin = end + 1) {
+      end = std::min(value.find(':', begin), value.length());
+      std::string path = value.substr(begin, end - begin);
+      if (path.compare(0, 7, "$ORIGIN") == 0)
+        path = origin + path.substr(7);
+      else if (path.compare(0, 9, "${ORIGIN}") == 0)
+        path = origin + path.substr(9);
+      else if (path[0] == '/')
+        path = sysroot + path;
+      else
+        continue;
+      dependencies.search.push_back(path);
+    }
+  }
+
+  return true;
+}
+
+std::string dirname(const std::string &path) {
+  const auto separator = path.rfind('/');
+  if (separator == std::string::npos)
+    return ".";
+  return separator ? path.substr(0, separator) : "/";
+}
+
+int locate(const std::string &soname, const std::vector<std::string> &search,
+           const multiload::library_index &index, const std::string &sysroot,
+           std::string &library) {
+  // a candidate may be a FIFO, whose open would not return until a writer
+  // appears
+  constexpr const int flags = O_RDONLY | O_NONBLOCK | O_CLOEXEC;
+
+  int fd;
+  for (const auto &directory : search) {
+    library = directory + "/" + soname;
+    if ((fd = ::open(library.c_str(), flags)) >= 0)
+      return fd;
+  }
+
+  if (index) {
+    const char *indexed = index.find(soname.c_str());
+    if (not indexed)
+      return -1;
+    library = indexed;
+    return ::open(library.c_str(), flags);
+  }
+
+  for (const auto *directory : multiload::library_index::defaults) {
+    library = sysroot + directory + "/" + soname;
+    if ((fd = ::open(library.c_str(), flags)) >= 0)
+      return fd;
+  }
+  return -1;
+}
+
+void walk(const char *path, const uint8_t *base, size_t size,
+          const std::string &sysroot, size_t budget) noexcept {
+  const elf::reader image(base, size);
+  struct dependencies dependencies;
+  if (not image or
+      not enumerate(image, dirname(path), sysroot, dependencies))
+    return;
+
+  const deadline deadline(multiload::library_deadline);
+
+  // building the index is not bounded by the deadline, so a missing or stale
+  // index is only rebuilt once the libraries have been located without it
+  multiload::library_index index;
+  const bool indexed = index.open(sysroot);
+
+  // breadth first, which approximates the order of the dynamic linker
+  struct request {
+    std::string soname;
+    size_t search;
+  };
+  std::vector<std::vector<std::string>> searches{ dependencies.search };
+  std::vector<request> pending;
+  std::set<std::string> visited;
+  for (const auto &soname : dependencies.needed)
+    if (visited.insert(soname).second)
+      pending.push_back({ soname, 0 });
+
+  for (size_t next = 0; next < pending.size() and budget; ++next) {
+    if (deadline.expired())
+      break;
+
+    const auto &soname = pending[next].soname;
+    if (soname.find('/') != std::string::npos)
+      continue;
+
+    std::string library;
+    multiload::scoped_file_descriptor fd(
+        locate(soname, searches[pending[next].search], index, sysroot,
+               library));
+    struct stat st;
+    if (fd < 0 or ::fstat(fd, &st) < 0 or not S_ISREG(st.st_mode))
+      continue;
+
+    void *address = ::mmap(NULL, st.st_size, PROT_READ,
+                           MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    multiload::scoped_mmap mapping(address, st.st_size);
+    if (mapping == MAP_FAILED)
+      continue;
+
+    const elf::reader library_image(mapping, st.st_size);
+    if (not library_image)
+      continue;
+    budget -= schedule(fd, library_image, budget);
+
+    struct dependencies transitive;
+    if (not enumerate(library_image, dirname(library), sysroot, transitive))
+      continue;
+
+    size_t search = 0;
+    if (not transitive.search.empty()) {
+      search = searches.size();
+      searches.push_back(std::move(transitive.search));
+    }
+    for (auto &soname : transitive.needed)
+      if (visited.insert(soname).second)
+        pending.push_back({ std::move(soname), search });
+  }
+
+  if (not indexed)
+    multiload::library_index::build(sysroot);
+}
+
+struct job {
+  const char *path;
+  const uint8_t *base;
+  size_t size;
+  const std::string &sysroot;
+  size_t budget;
+};
+
+int detach(void *argument) {
+  const auto *job = static_cast<const struct job *>(argument);
+
+  // hold none of the descriptors of the dispatch, which would keep pipes open
+  // and admission slots held once the loader exits
+  ::close_range(0, ~0u, 0);
+  walk(job->path, job->base, job->size, job->sysroot, job->budget);
+  ::_exit(EXIT_SUCCESS);
+}
+}
+
+namespace multiload {
+void prefetch_segments(int fd, const uint8_t *base, size_t size,
+                       size_t budget) noexcept {
+  if (const elf::reader image{ base, size })
+    schedule(fd, image, budget);
+}
+
+void prefetch_libraries(const char *path, const uint8_t *base, size_t size,
+                        const std::string &sysroot, size_t budget) noexcept {
+  constexpr const size_t stack_size = 1 << 20;
+  void *stack = ::mmap(NULL, stack_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (stack == MAP_FAILED)
+    return;
+
+  // the child is a copy of the process which signals nothing when it exits:
+  // it is neither waited for here nor reported to the loader, whose wait()
+  // only collects children which do
+  job job = { path, base, size, sysroot, budget };
+  ::clone(detach, static_cast<uint8_t *>(stack) + stack_size, 0, &job);
+  ::munmap(stack, stack_size);
+}
+}
@@ -0,0 +1,102 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/probe.hh"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+constexpr size_t prefix(multiload::probe::extent extent) noexcept {
+  return extent == multiload::probe::extent::header ? 4096
+                                                    : multiload::note_window;
+}
+}
+
+namespace multiload {
+probe::probe(int fd, size_t size) noexcept
+    : fd_(fd), base_(nullptr), size_(size) {
+  // the reservation is zero filled, so reads beyond the prefix are harmless
+  void *base = ::mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base != MAP_FAILED)
+    base_ = static_cast<uint8_t *>(base);
+}
+
+probe::probe(const uint8_t *image, size_t size) noexcept
+    : fd_(-1), base_(const_cast<uint8_t *>(image)), size_(size) {}
+
+probe::~probe() noexcept {
+  if (fd_ >= 0 and base_)
+    ::munmap(base_, size_);
+}
+
+bool probe::fetch(extent extent) noexcept {
+  if (not base_)
+    return false;
+
+  const size_t length =
+      extent == extent::image ? size_ : std::min(size_, prefix(extent));
+  if (length <= length_)
+    return true;
+
+  if (fd_ < 0) {
+    ++reads_;
+    bytes_ = bytes_ + length - length_;
+    length_ = length;
+    return true;
+  }
+
+  // the binary is mapped over the reservation rather than read, leaving the
+  // actions to fault in only what they use
+  if (extent == extent::image) {
+    if (::mmap(base_, size_, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd_, 0) ==
+        MAP_FAILED)
+      return false;
+    length_ = size_;
+    return true;
+  }
+
+  while (length_ < length) {
+    const ssize_t count =
+        ::pread(fd_, base_ + length_, length - length_, length_);
+    if (count < 0 and errno == EINTR)
+      continue;
+    ++reads_;
+    if (count <= 0)
+      return false;
+    bytes_ = bytes_ + count;
+    length_ = length_ + count;
+  }
+  return true;
+}
+}
@@ -0,0 +1,386 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/runtimes.hh"
+#include "multiload/host.hh"
+#include "multiload/scoped-file-descriptor.hh"
+#include "multiload/state.hh"
+
+#include "elf/reader.hh"
+
+#include "support/hash.hh"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+using multiload::state::location;
+using multiload::state::trusted;
+
+constexpr const uint32_t magic = 0x52444c4d;  // MLDR
+constexpr const uint32_t version = 2;
+constexpr const size_t cache_line = 64;
+
+// a key resides within a window of slots starting at the slot it selects by
+// masking, which bounds the probes of a lookup
+constexpr const size_t slots = 4096;
+constexpr const size_t window = 4;
+
+// a reader gives up on a slot which a writer holds for this many attempts
+constexpr const unsigned attempts = 64;
+
+// the mean is weighted exponentially over roughly this many runs so that it
+// follows changes to the binary or the loaders
+constexpr const uint32_t horizon = 8;
+
+struct header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slots;
+};
+
+// the sequence of a slot is odd while it is being written, and its upper half
+// is then the pid of the writer so that a slot abandoned by a writer which was
+// killed midway can be reclaimed
+struct slot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> key;                  // 0 if unused
+  std::atomic<uint32_t> runs[multiload::runtimes::candidates];
+  std::atomic<uint32_t> mean[multiload::runtimes::candidates];
+};
+
+static_assert(sizeof(header) <= cache_line, "header must fit a cache line");
+static_assert(sizeof(slot) <= cache_line, "slot must fit a cache line");
+
+constexpr const size_t length = cache_line + slots * cache_line;
+
+slot *at(void *base, uint64_t index) noexcept {
+  return reinterpret_cast<slot *>(static_cast<uint8_t *>(base) + cache_line +
+                                  (index & (slots - 1)) * cache_line);
+}
+
+bool valid(const void *base) noexcept {
+  const auto *hdr = static_cast<const header *>(base);
+  return hdr->magic == magic and hdr->version == version and
+         hdr->slots == slots;
+}
+
+int create(const std::string &path) noexcept {
+  std::string temporary = path + ".XXXXXX";
+  int fd = ::mkostemp(&temporary[0], O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  const header hdr = { magic, version, static_cast<uint32_t>(slots) };
+  if (::fchmod(fd, 0644) < 0 or ::ftruncate(fd, length) < 0 or
+      ::pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) or
+      ::rename(temporary.c_str(), path.c_str()) < 0) {
+    ::unlink(temporary.c_str());
+    ::close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+// map the table, creating it if it is to be written and is absent or stale
+void *map(bool writable) noexcept {
+  const std::string path = location("runtimes");
+  multiload::scoped_file_descriptor fd(
+      ::open(path.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC));
+
+  struct stat st;
+  if (fd >= 0 and ::fstat(fd, &st) == 0 and trusted(st) and
+      static_cast<size_t>(st.st_size) >= length) {
+    void *base = ::mmap(NULL, length, PROT_READ | (writable ? PROT_WRITE : 0),
+                        MAP_SHARED, fd, 0);
+    if (base != MAP_FAILED) {
+      if (valid(base))
+        return base;
+      ::munmap(base, length);
+    }
+  }
+
+  if (not writable)
+    return nullptr;
+
+  multiload::scoped_file_descriptor replacement(create(path));
+  if (replacement < 0)
+    return nullptr;
+
+  void *base = ::mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      replacement, 0);
+  return base == MAP_FAILED ? nullptr : base;
+}
+
+using history = multiload::runtimes::sample[multiload::runtimes::candidates];
+
+// a consistent copy of the slot; false if a writer held it throughout
+bool snapshot(const slot &entry, uint64_t &key, history &samples) noexcept {
+  for (unsigned attempt = 0; attempt < attempts; ++attempt) {
+    const uint64_t sequence = entry.sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+      continue;
+
+    key = entry.key.load(std::memory_order_relaxed);
+    for (size_t candidate = 0; candidate < multiload::runtimes::candidates;
+         ++candidate)
+      samples[candidate] = {
+        entry.runs[candidate].load(std::memory_order_relaxed),
+        entry.mean[candidate].load(std::memory_order_relaxed),
+      };
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry.sequence.load(std::memory_order_relaxed) == sequence)
+      return true;
+  }
+  return false;
+}
+
+// take the slot for writing; a slot held by a writer which has since died is
+// taken over, in which case its contents are not to be trusted
+bool claim(slot &entry, bool &abandoned) noexcept {
+  const uint64_t writer = static_cast<uint64_t>(::getpid()) << 32;
+
+  uint64_t sequence = entry.sequence.load(std::memory_order_relaxed);
+  abandoned = sequence & 1;
+  if (abandoned) {
+    const pid_t holder = static_cast<pid_t>(sequence >> 32);
+    if (::kill(holder, 0) == 0 or errno != ESRCH)
+      return false;
+  }
+
+  // the sequence remains odd when the slot is taken over
+  const uint64_t claimed = writer | static_cast<uint32_t>(sequence + 1 +
+                                                          abandoned);
+  return entry.sequence.compare_exchange_strong(sequence, claimed,
+                                                std::memory_order_relaxed);
+}
+
+volatile sig_atomic_t child;
+
+// signals sent to the supervisor are meant for the loader; those generated by
+// the terminal reach the loader directly through its process group
+void forward(int signal, siginfo_t *info, void *) {
+  if (child > 0 and info->si_code <= 0)
+    ::kill(child, signal);
+}
+}
+
+namespace multiload {
+namespace runtimes {
+uint64_t key(const std::string &loader,
+             const std::vector<std::string> &alternatives, int fd,
+             const uint8_t *base, size_t size) noexcept {
+  uint64_t key = hash::fnv1a(loader);
+  for (const auto &alternative : alternatives)
+    key = hash::fnv1a(alternative, key);
+
+  struct stat st = {};
+  if (::fstat(fd, &st) == 0) {
+    key = hash::fnv1a(&st.st_dev, sizeof(st.st_dev), key);
+    key = hash::fnv1a(&st.st_ino, sizeof(st.st_ino), key);
+  }
+
+  // a binary rebuilt in place is a different binary
+  size_t length;
+  const elf::reader image(base, size);
+  if (const uint8_t *build_id =
+          image ? image.note(elf::segment_type::note,
+                             elf::note_type::gnu_build_id, length)
+                : nullptr)
+    key = hash::fnv1a(build_id, length, key);
+  else
+    key = hash::fnv1a(&st.st_mtim, sizeof(st.st_mtim), key);
+
+  return key ? key : 1;
+}
+
+bool lookup(uint64_t key, sample (&samples)[candidates]) noexcept {
+  void *base = map(false);
+  if (not base)
+    return false;
+
+  bool found = false;
+  for (size_t probe = 0; probe < window and not found; ++probe) {
+    uint64_t resident;
+    found = snapshot(*at(base, key + probe), resident, samples) and
+            resident == key;
+  }
+
+  ::munmap(base, length);
+  return found;
+}
+
+size_t choose(uint64_t key, size_t count, unsigned explore) noexcept {
+  sample samples[candidates];
+  if (count < 2 or not lookup(key, samples))
+    return 0;
+
+  struct timespec now;
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  const uint64_t roll =
+      hash::fnv1a(&now, sizeof(now), hash::fnv1a_basis ^ ::getpid());
+
+  if (roll % 100 < explore) {
+    // a loader which has yet to complete a run is the most informative
+    for (size_t candidate = 0; candidate < count; ++candidate)
+      if (not samples[candidate].runs)
+        return candidate;
+    return (roll / 100) % count;
+  }
+
+  size_t fastest = 0;
+  for (size_t candidate = 1; candidate < count; ++candidate)
+    if (samples[candidate].runs and
+        (not samples[fastest].runs or
+         samples[candidate].mean < samples[fastest].mean))
+      fastest = candidate;
+  return fastest;
+}
+
+void record(uint64_t key, size_t candidate, uint64_t duration) noexcept {
+  void *base = map(true);
+  if (not base)
+    return;
+
+  // the slot holding the key, else the first unused one, else the first of
+  // the window is evicted
+  slot *entry = nullptr;
+  for (size_t probe = 0; probe < window; ++probe) {
+    slot *current = at(base, key + probe);
+    const uint64_t resident = current->key.load(std::memory_order_relaxed);
+    if (resident == key) {
+      entry = current;
+      break;
+    }
+    if (not resident and not entry)
+      entry = current;
+  }
+  if (not entry)
+    entry = at(base, key);
+
+  // the sequence doubles as the lock between writers; a sample which races
+  // with another is dropped rather than waited upon
+  bool abandoned;
+  if (not claim(*entry, abandoned)) {
+    ::munmap(base, length);
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  const uint32_t sequence = entry->sequence.load(std::memory_order_relaxed);
+
+  if (abandoned or entry->key.load(std::memory_order_relaxed) != key) {
+    for (size_t index = 0; index < candidates; ++index) {
+      entry->runs[index].store(0, std::memory_order_relaxed);
+      entry->mean[index].store(0, std::memory_order_relaxed);
+    }
+    entry->key.store(key, std::memory_order_relaxed);
+  }
+
+  const int64_t elapsed =
+      std::min<uint64_t>(duration / 1000, std::numeric_limits<uint32_t>::max());
+  const uint32_t runs = entry->runs[candidate].load(std::memory_order_relaxed);
+  const int64_t mean = entry->mean[candidate].load(std::memory_order_relaxed);
+  const uint32_t weight = std::min(runs + 1, horizon);
+  if (runs != std::numeric_limits<uint32_t>::max())
+    entry->runs[candidate].store(runs + 1, std::memory_order_relaxed);
+  entry->mean[candidate].store(mean + (elapsed - mean) / weight,
+                               std::memory_order_relaxed);
+
+  entry->sequence.store(static_cast<uint32_t>(sequence + 1),
+                        std::memory_order_release);
+  ::munmap(base, length);
+}
+
+void supervise(uint64_t key, size_t candidate, const char *loader,
+               char *argv[]) noexcept {
+  struct timespec start;
+  ::clock_gettime(CLOCK_MONOTONIC, &start);
+
+  const pid_t supervisor = ::getpid();
+  const pid_t pid = ::fork();
+  if (pid <= 0) {
+    // the loader does not outlive its supervisor, which its invoker would
+    // take for the loader itself
+    if (pid == 0 and (::prctl(PR_SET_PDEATHSIG, SIGKILL) < 0 or
+                      ::getppid() != supervisor))
+      ::_exit(127);
+
+    // without a child the loader simply goes unmeasured
+    ::execvpe(loader, argv, environ);
+    std::cerr << "unable to execute '" << loader << "': "
+              << std::strerror(errno) << std::endl;
+    if (pid == 0)
+      ::_exit(127);
+    ::exit(EXIT_FAILURE);
+  }
+
+  child = pid;
+  struct sigaction action = {};
+  action.sa_sigaction = forward;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  for (const int signal : { SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGUSR1,
+                            SIGUSR2 })
+    ::sigaction(signal, &action, nullptr);
+
+  int status;
+  while (::waitpid(pid, &status, 0) < 0)
+    if (errno != EINTR)
+      ::exit(EXIT_FAILURE);
+
+  struct timespec end;
+  ::clock_gettime(CLOCK_MONOTONIC, &end);
+
+  // a loader which fails may well do so quickly; only completed runs inform
+  // the choice
+  if (WIFEXITED(status) and WEXITSTATUS(status) == EXIT_SUCCESS)
+    record(key, candidate,
+           (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec -
+               start.tv_nsec);
+
+  host::propagate(status);
+}
+}
+}
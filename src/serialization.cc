@@ -0,0 +1,245 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/configuration.hh"
+
+#include <cstring>
+#include <iostream>
+
+// The serialized form of a rule set: a header followed by each rule.  Strings
+// are length prefixed, integers are stored in host byte order as the image is
+// only ever consumed on the host which produced it.
+
+namespace {
+constexpr const uint32_t magic = 0x46434c4d;  // MLCF
+constexpr const uint32_t version = 8;
+
+class writer {
+  std::string &buffer_;
+
+public:
+  explicit writer(std::string &buffer) noexcept : buffer_(buffer) {}
+
+  void emit(uint64_t value) {
+    buffer_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  void emit(const std::string &value) {
+    emit(static_cast<uint64_t>(value.length()));
+    buffer_.append(value);
+  }
+};
+
+class reader {
+  const uint8_t *cursor_;
+  const uint8_t *end_;
+
+public:
+  reader(const uint8_t *image, size_t size) noexcept
+      : cursor_(image), end_(image + size) {}
+
+  bool read(uint64_t &value) noexcept {
+    if (static_cast<size_t>(end_ - cursor_) < sizeof(value))
+      return false;
+    std::memcpy(&value, cursor_, sizeof(value));
+    cursor_ = cursor_ + sizeof(value);
+    return true;
+  }
+
+  bool read(std::string &value) {
+    uint64_t length;
+    if (not read(length) or static_cast<size_t>(end_ - cursor_) < length)
+      return false;
+    value.assign(reinterpret_cast<const char *>(cursor_), length);
+    cursor_ = cursor_ + length;
+    return true;
+  }
+
+  // each element of a sequence occupies at least one length
+  bool read(uint64_t &count, size_t element) noexcept {
+    return read(count) and
+           count <= static_cast<size_t>(end_ - cursor_) / element;
+  }
+
+  bool read(multiload::configuration::rule &rule) {
+    uint64_t constraints, readahead, resident, prefetch, address_space, files,
+        max_concurrent, queue_timeout, forkable, candidates, explore;
+
+    if (not read(rule.loader) or not read(constraints, 2 * sizeof(uint64_t)))
+      return false;
+    rule.constraints.resize(constraints);
+    for (auto &constraint : rule.constraints)
+      if (not read(constraint.key) or not read(constraint.value))
+        return false;
+
+    if (not read(readahead) or not read(resident, sizeof(uint64_t)))
+      return false;
+    rule.readahead = readahead;
+    rule.resident.resize(resident);
+    for (auto &path : rule.resident)
+      if (not read(path))
+        return false;
+
+    if (not read(rule.sysroot) or not read(prefetch) or
+        not read(rule.execfd) or not read(rule.variant))
+      return false;
+    rule.prefetch = prefetch;
+
+    auto &policy = rule.policy;
+    if (not read(policy.affinity) or not read(policy.scheduler) or
+        not read(policy.nice) or not read(policy.ioprio) or
+        not read(policy.cgroup) or not read(address_space) or
+        not read(files))
+      return false;
+    policy.address_space = address_space;
+    policy.files = files;
+
+    if (not read(max_concurrent) or not read(queue_timeout))
+      return false;
+    rule.max_concurrent = max_concurrent;
+    rule.queue_timeout = queue_timeout;
+
+    if (not read(rule.forkserver) or not read(forkable, sizeof(uint64_t)))
+      return false;
+    rule.forkable.resize(forkable);
+    for (auto &pattern : rule.forkable)
+      if (not read(pattern))
+        return false;
+
+    if (not read(candidates, sizeof(uint64_t)))
+      return false;
+    rule.candidates.resize(candidates);
+    for (auto &candidate : rule.candidates)
+      if (not read(candidate))
+        return false;
+    if (not read(explore))
+      return false;
+    rule.explore = explore;
+
+    return true;
+  }
+
+  bool exhausted() const noexcept {
+    return cursor_ == end_;
+  }
+};
+}
+
+namespace multiload {
+std::string configuration::serialize(const std::vector<rule> &rules) {
+  std::string image;
+  writer stream(image);
+
+  stream.emit(static_cast<uint64_t>(magic) << 32 | version);
+  stream.emit(rules.size());
+  for (const auto &rule : rules) {
+    stream.emit(rule.loader);
+    stream.emit(rule.constraints.size());
+    for (const auto &constraint : rule.constraints) {
+      stream.emit(constraint.key);
+      stream.emit(constraint.value);
+    }
+    stream.emit(rule.readahead);
+    stream.emit(rule.resident.size());
+    for (const auto &path : rule.resident)
+      stream.emit(path);
+    stream.emit(rule.sysroot);
+    stream.emit(rule.prefetch);
+    stream.emit(rule.execfd);
+    stream.emit(rule.variant);
+    stream.emit(rule.policy.affinity);
+    stream.emit(rule.policy.scheduler);
+    stream.emit(rule.policy.nice);
+    stream.emit(rule.policy.ioprio);
+    stream.emit(rule.policy.cgroup);
+    stream.emit(rule.policy.address_space);
+    stream.emit(rule.policy.files);
+    stream.emit(rule.max_concurrent);
+    stream.emit(rule.queue_timeout);
+    stream.emit(rule.forkserver);
+    stream.emit(rule.forkable.size());
+    for (const auto &pattern : rule.forkable)
+      stream.emit(pattern);
+    stream.emit(rule.candidates.size());
+    for (const auto &candidate : rule.candidates)
+      stream.emit(candidate);
+    stream.emit(rule.explore);
+  }
+
+  return image;
+}
+
+std::string configuration::serialize() const {
+  return serialize(rules_);
+}
+
+bool configuration::deserialize(const uint8_t *image, size_t size,
+                                std::vector<rule> &rules) {
+  reader stream(image, size);
+
+  uint64_t signature, count;
+  if (not stream.read(signature) or
+      signature != (static_cast<uint64_t>(magic) << 32 | version) or
+      not stream.read(count, sizeof(uint64_t)))
+    return false;
+
+  rules.clear();
+  for (uint64_t index = 0; index < count; ++index) {
+    rule rule;
+    if (not stream.read(rule))
+      break;
+    rules.push_back(std::move(rule));
+  }
+
+  return rules.size() == count and stream.exhausted();
+}
+
+bool configuration::load(const uint8_t *image, size_t size) noexcept {
+  std::vector<rule> rules;
+  if (not deserialize(image, size, rules)) {
+    std::cerr << "invalid configuration image '" << file_ << "'" << std::endl;
+    return false;
+  }
+
+  if (not layer())
+    return false;
+
+  sources_.push_back(file_);
+  append(std::move(rules));
+  return resolve();
+}
+
+bool configuration::restore(const uint8_t *image, size_t size) noexcept {
+  if (not deserialize(image, size, rules_))
+    return false;
+
+  sources_.assign(1, file_);
+  return resolve();
+}
+}
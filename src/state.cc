@@ -0,0 +1,64 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/state.hh"
+
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+constexpr const char directory[] = LOCALSTATEDIR "/lib/multiload";
+
+void append(std::string &path, uint64_t value) {
+  static constexpr const char digits[] = "0123456789abcdef";
+  for (int shift = 60; shift >= 0; shift -= 4)
+    path.push_back(digits[(value >> shift) & 0xf]);
+}
+}
+
+namespace multiload {
+namespace state {
+std::string location(const char *name) {
+  return std::string(directory) + "/" + name + "-" +
+         std::to_string(::geteuid());
+}
+
+std::string location(const char *name, uint64_t key) {
+  std::string path = location(name) + "-";
+  append(path, key);
+  return path;
+}
+
+bool trusted(const struct stat &st) noexcept {
+  return S_ISREG(st.st_mode) and
+         (st.st_uid == 0 or st.st_uid == ::geteuid()) and
+         not (st.st_mode & (S_IWGRP | S_IWOTH));
+}
+}
+}
@@ -0,0 +1,235 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include "multiload/statistics.hh"
+#include "multiload/scoped-file-descriptor.hh"
+#include "multiload/state.hh"
+
+#include "support/compiler.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+constexpr const uint32_t magic = 0x53444c4d;  // MLDS
+constexpr const uint32_t version = 2;
+constexpr const size_t cache_line = 64;
+
+// the counters of each rule, stored as consecutive arrays indexed by rule
+enum counter : size_t {
+  dispatched,
+  queued,
+  queue_time,
+  expired,
+  counters,
+};
+
+struct header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t fingerprint;
+  uint32_t cpus;
+  uint32_t rules;
+};
+
+static_assert(sizeof(header) <= cache_line, "header must fit a cache line");
+
+constexpr size_t stride(size_t counters) noexcept {
+  return (counters * sizeof(uint64_t) + cache_line - 1) & ~(cache_line - 1);
+}
+
+constexpr size_t length(size_t cpus, size_t rules) noexcept {
+  return cache_line + cpus * stride(counters * rules) +
+         cpus * stride(multiload::statistics::machines);
+}
+
+bool valid(const void *base, uint64_t fingerprint, size_t cpus,
+           size_t rules) noexcept {
+  const auto *hdr = static_cast<const header *>(base);
+  return hdr->magic == magic and hdr->version == version and
+         hdr->fingerprint == fingerprint and hdr->cpus == cpus and
+         hdr->rules == rules;
+}
+
+int create(const std::string &path, uint64_t fingerprint, size_t cpus,
+           size_t rules) noexcept {
+  std::string temporary = path + ".XXXXXX";
+  int fd = ::mkostemp(&temporary[0], O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  const header hdr = { magic, version, fingerprint, static_cast<uint32_t>(cpus),
+                       static_cast<uint32_t>(rules) };
+  if (::fchmod(fd, 0644) < 0 or
+      ::ftruncate(fd, length(cpus, rules)) < 0 or
+      ::pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) or
+      ::rename(temporary.c_str(), path.c_str()) < 0) {
+    ::unlink(temporary.c_str());
+    ::close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+}
+
+namespace multiload {
+statistics::~statistics() noexcept {
+  if (base_)
+    ::munmap(base_, size_);
+}
+
+bool statistics::open(uint64_t fingerprint, size_t rules,
+                      bool writable) noexcept {
+  const size_t cpus = ::get_nprocs_conf();
+  const size_t size = length(cpus, rules);
+
+  // each rule set has counters of its own, so that the configurations of
+  // concurrent jobs with different overlays do not replace each other's
+  const std::string path = state::location("statistics", fingerprint);
+  multiload::scoped_file_descriptor fd(
+      ::open(path.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC));
+
+  // a file which another user could truncate would fault its mappings
+  struct stat st;
+  if (fd >= 0 and ::fstat(fd, &st) == 0 and state::trusted(st) and
+      static_cast<size_t>(st.st_size) >= size) {
+    void *base = ::mmap(NULL, size, PROT_READ | (writable ? PROT_WRITE : 0),
+                        MAP_SHARED, fd, 0);
+    if (base != MAP_FAILED) {
+      if (valid(base, fingerprint, cpus, rules)) {
+        base_ = base, size_ = size, cpus_ = cpus, rules_ = rules;
+        return true;
+      }
+      ::munmap(base, size);
+    }
+  }
+
+  if (not writable)
+    return false;
+
+  multiload::scoped_file_descriptor replacement(create(path, fingerprint,
+                                                       cpus, rules));
+  if (replacement < 0)
+    return false;
+
+  void *base = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      replacement, 0);
+  if (base == MAP_FAILED)
+    return false;
+
+  base_ = base, size_ = size, cpus_ = cpus, rules_ = rules;
+  return true;
+}
+
+uint64_t *statistics::rule_shard(size_t cpu) const noexcept {
+  return reinterpret_cast<uint64_t *>(static_cast<uint8_t *>(base_) +
+                                      cache_line +
+                                      cpu * stride(counters * rules_));
+}
+
+uint64_t *statistics::miss_shard(size_t cpu) const noexcept {
+  return reinterpret_cast<uint64_t *>(static_cast<uint8_t *>(base_) +
+                                      cache_line +
+                                      cpus_ * stride(counters * rules_) +
+                                      cpu * stride(machines));
+}
+
+void statistics::increment(size_t counter, uint64_t value) const noexcept {
+  const int cpu = ::sched_getcpu();
+  __atomic_fetch_add(&rule_shard(cpu < 0 ? 0 : cpu % cpus_)[counter], value,
+                     __ATOMIC_RELAXED);
+}
+
+uint64_t statistics::total(size_t counter) const noexcept {
+  uint64_t total = 0;
+  for (size_t cpu = 0; cpu < cpus_; ++cpu)
+    total += __atomic_load_n(&rule_shard(cpu)[counter], __ATOMIC_RELAXED);
+  return total;
+}
+
+MULTILOAD_HOT void statistics::hit(size_t rule) const noexcept {
+  if (base_ and rule < rules_)
+    increment(dispatched * rules_ + rule, 1);
+}
+
+void statistics::miss(elf::machine machine) const noexcept {
+  if (not base_)
+    return;
+  const int cpu = ::sched_getcpu();
+  const size_t bucket = std::min<size_t>(static_cast<uint16_t>(machine),
+                                         machines - 1);
+  __atomic_fetch_add(&miss_shard(cpu < 0 ? 0 : cpu % cpus_)[bucket], 1,
+                     __ATOMIC_RELAXED);
+}
+
+void statistics::waited(size_t rule, uint64_t duration,
+                        bool timed_out) const noexcept {
+  if (not base_ or rule >= rules_)
+    return;
+  increment(queued * rules_ + rule, 1);
+  increment(queue_time * rules_ + rule, duration);
+  if (timed_out)
+    increment(expired * rules_ + rule, 1);
+}
+
+uint64_t statistics::hits(size_t rule) const noexcept {
+  return base_ and rule < rules_ ? total(dispatched * rules_ + rule) : 0;
+}
+
+uint64_t statistics::misses(size_t bucket) const noexcept {
+  uint64_t total = 0;
+  if (base_ and bucket < machines)
+    for (size_t cpu = 0; cpu < cpus_; ++cpu)
+      total += __atomic_load_n(&miss_shard(cpu)[bucket], __ATOMIC_RELAXED);
+  return total;
+}
+
+uint64_t statistics::waits(size_t rule) const noexcept {
+  return base_ and rule < rules_ ? total(queued * rules_ + rule) : 0;
+}
+
+uint64_t statistics::wait_time(size_t rule) const noexcept {
+  return base_ and rule < rules_ ? total(queue_time * rules_ + rule) : 0;
+}
+
+uint64_t statistics::timeouts(size_t rule) const noexcept {
+  return base_ and rule < rules_ ? total(expired * rules_ + rule) : 0;
+}
+}
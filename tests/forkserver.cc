@@ -0,0 +1,248 @@
+/**
+ * Copyright © 2015 Saleem Abdulrasool <compnerd@compnerd.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **/
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "multiload/architecture.hh"
+#include "multiload/forkserver.hh"
+#include "multiload/host.hh"
+
+// The lifecycle of a fork server: ld-multiload executes a forkable binary
+// itself while no fork server is listening, has it served by the parked
+// stand-in loader once multiload-forkserver is running (with the arguments,
+// environment, working directory, stdio and exit status or signal of the
+// invocation), and falls back again once the fork server has shut down, which
+// retires the parked loader.
+namespace {
+struct outcome {
+  pid_t pid;
+  int status;
+  std::string output;
+};
+
+// the report of the binary (run as --<status> or --raise): its pid, the pid of its parent, its working
+// directory, the value of MULTILOAD_TEST and the first line of its input
+int report(const char *mode) {
+  std::string input;
+  std::getline(std::cin, input);
+
+  char cwd[PATH_MAX];
+  const char *value = std::getenv("MULTILOAD_TEST");
+  std::cout << ::getpid() << ' ' << ::getppid() << ' '
+            << (::getcwd(cwd, sizeof(cwd)) ? cwd : "-") << ' '
+            << (value ? value : "-") << ' ' << input << std::endl;
+
+  if (std::strcmp(mode, "--raise") == 0)
+    ::raise(SIGUSR1);
+  return std::atoi(mode + 2);
+}
+
+outcome dispatch(const std::string &directory, const std::string &configuration,
+                 const std::string &binary, const char *mode) {
+  int input[2], output[2];
+  if (::pipe2(input, O_CLOEXEC) < 0 or ::pipe2(output, O_CLOEXEC) < 0) {
+    std::perror("pipe2");
+    std::exit(EXIT_FAILURE);
+  }
+
+  outcome outcome = { ::fork(), -1, {} };
+  if (outcome.pid < 0) {
+    std::perror("fork");
+    std::exit(EXIT_FAILURE);
+  }
+  if (outcome.pid == 0) {
+    if (::dup2(input[0], STDIN_FILENO) < 0 or
+        ::dup2(output[1], STDOUT_FILENO) < 0 or
+        ::chdir(directory.c_str()) < 0 or
+        ::setenv("MULTILOAD_TEST", "passed", 1) < 0)
+      ::_exit(127);
+    ::execl(LD_MULTILOAD, LD_MULTILOAD, "--config", configuration.c_str(),
+            binary.c_str(), mode, nullptr);
+    ::_exit(127);
+  }
+
+  ::close(input[0]);
+  ::close(output[1]);
+  (void)!::write(input[1], "line\n", 5);
+  ::close(input[1]);
+
+  char buffer[512];
+  for (ssize_t count;
+       (count = ::read(output[0], buffer, sizeof(buffer))) != 0;)
+    if (count > 0)
+      outcome.output.append(buffer, count);
+    else if (errno != EINTR)
+      break;
+  ::close(output[0]);
+
+  while (::waitpid(outcome.pid, &outcome.status, 0) < 0 and errno == EINTR)
+    ;
+  return outcome;
+}
+
+bool failed = false;
+
+void expect(bool condition, const char *message) {
+  if (condition)
+    return;
+  std::cerr << "FAIL: " << message << std::endl;
+  failed = true;
+}
+
+// checks the report of a dispatch and returns the pid of the parent of the
+// binary
+pid_t verify(const outcome &outcome, const std::string &directory,
+             bool served) {
+  std::istringstream fields(outcome.output);
+  pid_t pid = 0, parent = 0;
+  std::string cwd, value, input;
+  fields >> pid >> parent >> cwd >> value >> input;
+
+  expect(cwd == directory, "the working directory is that of the invocation");
+  expect(value == "passed", "the environment is that of the invocation");
+  expect(input == "line", "stdin is that of the invocation");
+  if (served)
+    expect(pid != outcome.pid, "the binary is served by the fork server");
+  else
+    expect(pid == outcome.pid, "the binary is executed by ld-multiload");
+  return parent;
+}
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 and std::strncmp(argv[1], "--", 2) == 0)
+    return report(argv[1]);
+
+  // a test which does not complete is a failure
+  ::alarm(60);
+
+  const auto *architecture = multiload::lookup(multiload::host::machine());
+  if (not architecture) {
+    std::cerr << "unknown host architecture" << std::endl;
+    return 77;
+  }
+
+  // the daemon and the parked loader are reaped here once orphaned
+  ::prctl(PR_SET_CHILD_SUBREAPER, 1);
+  ::unsetenv("MULTILOAD_CONFIG");
+  ::unsetenv("MULTILOAD_MEMFD");
+
+  const char *temporary = std::getenv("TMPDIR");
+  std::string pattern = std::string(temporary ? temporary : "/tmp") +
+                        "/multiload.XXXXXX";
+  char directory[PATH_MAX], binary[PATH_MAX];
+  if (not ::mkdtemp(&pattern[0]) or not ::realpath(pattern.c_str(), directory) or
+      not ::realpath("/proc/self/exe", binary)) {
+    std::perror("unable to prepare the test");
+    return EXIT_FAILURE;
+  }
+
+  const std::string configuration = std::string(directory) + "/multiload.conf";
+  FILE *file = std::fopen(configuration.c_str(), "w");
+  if (not file) {
+    std::perror("fopen");
+    return EXIT_FAILURE;
+  }
+  std::fprintf(file,
+               "loader %s { arch %s; forkserver %s; forkable %s; }\n",
+               STANDIN_LOADER, architecture->name, directory, binary);
+  std::fclose(file);
+
+  const std::string socket =
+      multiload::forkserver::socket(directory, binary);
+
+  // no fork server is listening
+  verify(dispatch(directory, configuration, binary, "--0"), directory, false);
+
+  const pid_t daemon = ::fork();
+  if (daemon == 0) {
+    ::execl(MULTILOAD_FORKSERVER, MULTILOAD_FORKSERVER, "--config",
+            configuration.c_str(), binary, nullptr);
+    ::_exit(127);
+  }
+
+  // the socket is bound once the loader has parked
+  struct stat st;
+  for (int attempt = 0; attempt < 500; ++attempt) {
+    if (::stat(socket.c_str(), &st) == 0 and S_ISSOCK(st.st_mode))
+      break;
+    ::usleep(10000);
+  }
+  expect(::stat(socket.c_str(), &st) == 0, "the fork server is listening");
+
+  // each invocation is forked from the same parked loader
+  outcome served = dispatch(directory, configuration, binary, "--0");
+  const pid_t loader = verify(served, directory, true);
+  expect(WIFEXITED(served.status) and WEXITSTATUS(served.status) == 0,
+         "a successful invocation succeeds");
+
+  served = dispatch(directory, configuration, binary, "--3");
+  expect(verify(served, directory, true) == loader,
+         "invocations are served by the parked loader");
+  expect(WIFEXITED(served.status) and WEXITSTATUS(served.status) == 3,
+         "the exit status of the invocation is propagated");
+
+  served = dispatch(directory, configuration, binary, "--raise");
+  expect(verify(served, directory, true) == loader,
+         "invocations are served by the parked loader");
+  expect(WIFSIGNALED(served.status) and WTERMSIG(served.status) == SIGUSR1,
+         "the signal terminating the invocation is propagated");
+
+  // shutting the fork server down retires the parked loader
+  int status;
+  ::kill(daemon, SIGTERM);
+  expect(::waitpid(daemon, &status, 0) == daemon and WIFEXITED(status) and
+             WEXITSTATUS(status) == EXIT_SUCCESS,
+         "the fork server shuts down");
+  expect(::access(socket.c_str(), F_OK) < 0, "the socket is removed");
+  expect(::waitpid(loader, &status, 0) == loader and WIFEXITED(status) and
+             WEXITSTATUS(status) == EXIT_SUCCESS,
+         "the parked loader exits with the fork server");
+
+  verify(dispatch(directory, configuration, binary, "--0"), directory, false);
+
+  ::unlink(configuration.c_str());
+  ::rmdir(directory);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}